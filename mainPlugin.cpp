@@ -5,8 +5,12 @@
 
 #include "stressMap.h"  //change include header for each node
 #include "stressMapOverride.h"
+#include "stressMapBake.h"
+#include "stressParallel.h"
+#include "stressTopologyData.h"
 #include <maya/MDrawRegistry.h>
 #include <maya/MGlobal.h>
+#include <maya/MProfiler.h>
 #include <maya/MFnPlugin.h> //Maya class that redisters and deregisters plug-ins with Maya
 
 const MString pluginRegistrantId("stressMap");
@@ -15,6 +19,14 @@ MStatus initializePlugin(MObject obj){
   MStatus status;
   MFnPlugin fnplugin(obj, "McKenzie Burch", "1.0", "Any");
 
+  //the node's topologyCache attribute is of this type, it has to exist first
+  status = fnplugin.registerData(StressTopologyData::typeName, StressTopologyData::id, StressTopologyData::creator);
+
+  if(status != MS::kSuccess){
+    status.perror("Could not register the stressTopologyData type");
+    return status;
+  }
+
   status = fnplugin.registerNode("stressMap", StressMap::typeId, StressMap::creator, StressMap::initialize, MPxNode::kLocatorNode, &StressMap::kDrawDbClassification);
 
   if(status != MS::kSuccess){
@@ -22,6 +34,13 @@ MStatus initializePlugin(MObject obj){
     return status;
   }
 
+  status = fnplugin.registerCommand("stressMapBake", StressMapBake::creator, StressMapBake::newSyntax);
+
+  if(status != MS::kSuccess){
+    status.perror("Could not register the stressMapBake command");
+    return status;
+  }
+
   //register the box handle draw override
   status = MHWRender::MDrawRegistry::registerDrawOverrideCreator(StressMap::kDrawDbClassification, pluginRegistrantId, StressMapOverride::creator);
 
@@ -37,6 +56,10 @@ MStatus uninitializePlugin(MObject obj){
   MFnPlugin pluginFn;
   //deregister the given user defined node type Maya
   pluginFn.deregisterNode(StressMap::typeId);
+  pluginFn.deregisterCommand("stressMapBake");
+  pluginFn.deregisterData(StressTopologyData::id);
+  MProfiler::removeCategory("stressMap");
+  StressThreadPool::instance().stop();  //no worker may be left running the plugin's code once it is unloaded
 
   MStatus status = MHWRender::MDrawRegistry::deregisterDrawOverrideCreator(StressMap::kDrawDbClassification, pluginRegistrantId);
 
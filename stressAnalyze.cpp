@@ -0,0 +1,289 @@
+//stressAnalyze.cpp
+//offline stress report over a sequence of point caches, runs without maya
+//
+//usage: stressAnalyze <reference.obj> <frame> [<frame> ...] [options]
+//  a frame is a deformed obj or a raw blob of float32 xyz triplets in reference vertex order
+//  -t threads      frames evaluated at once, 0 uses every core (default 0)
+//  -threshold x    list the vertices whose stress is above x or below -x (default 0.5)
+//  -start n        number of the first frame (default 0)
+//  -m multiplier   -c clampMax   -n (normalize), same as the node attributes
+//  -metric edge|area|major|minor, what the stress measures, same as the node's metric (default edge)
+//  -format csv|json (default csv)
+//  -o file         write the report to file instead of stdout
+//
+//frames are streamed, only a window of a few frames per thread is held in memory at any time
+
+#include "stressCore.h"
+#include "stressObj.h"
+#include "stressParallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct FrameReport{
+  double minimum = 0.0;
+  double maximum = 0.0;
+  double mean = 0.0;
+  std::vector<unsigned int> over;  //vertices past the threshold
+};
+
+//per thread buffers, reused for every frame the thread evaluates
+struct FrameScratch{
+  StressKernel kernel;
+  StressPositions points;
+  std::vector<float> raw;
+  std::vector<double> values;
+};
+
+static bool endsWith(const std::string& text, const char* suffix){
+  const size_t length = std::strlen(suffix);
+  return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+//raw point cache, numVertices float32 xyz triplets and nothing else
+static bool readRawPoints(const std::string& path, unsigned int numVertices, std::vector<float>& raw, StressPositions& points, std::string& error){
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if(!file){
+    error = "can't open " + path;
+    return false;
+  }
+  const std::streamoff size = file.tellg();
+  if(size != static_cast<std::streamoff>(numVertices) * 3 * static_cast<std::streamoff>(sizeof(float))){
+    error = path + ": expected " + std::to_string(numVertices) + " float32 xyz points";
+    return false;
+  }
+  raw.resize(static_cast<size_t>(numVertices) * 3);
+  file.seekg(0);
+  if(!file.read(reinterpret_cast<char*>(raw.data()), size)){
+    error = "can't read " + path;
+    return false;
+  }
+  points.resize(numVertices);
+  stressLoadPositions(raw.data(), points, 0, numVertices);
+  return true;
+}
+
+static bool evaluateFrame(const std::string& path, const StressTopology& topology, const std::vector<double>& invRestLengths,
+                          const StressTriangles& triangles, StressMetric metric, const StressSettings& settings, double threshold,
+                          FrameScratch& scratch, FrameReport& report, std::string& error){
+  const unsigned int numVertices = topology.numVertices();
+  if(endsWith(path, ".obj") || endsWith(path, ".OBJ")){
+    if(!stressReadObjPoints(path, scratch.points, error)) return false;
+    if(scratch.points.size() != numVertices){
+      error = path + ": has " + std::to_string(scratch.points.size()) + " points, the reference has " + std::to_string(numVertices);
+      return false;
+    }
+  }
+  else if(!readRawPoints(path, numVertices, scratch.raw, scratch.points, error)){
+    return false;
+  }
+
+  scratch.values.resize(numVertices);
+  StressStats stats;
+  if(metric == kStressEdgeLength){
+    scratch.kernel.compute(topology, invRestLengths, scratch.points, settings, scratch.values.data(), &stats);
+  }
+  else{
+    double* values = scratch.values.data();
+    scratch.kernel.computeTriangleMetrics(triangles, scratch.points, settings, metric == kStressArea ? values : nullptr,
+                                          metric == kStressMajorStrain ? values : nullptr, metric == kStressMinorStrain ? values : nullptr,
+                                          metric, &stats);
+  }
+  report.minimum = stats.minimum;
+  report.maximum = stats.maximum;
+  report.mean = stats.mean;
+
+  //the stats already tell when no vertex can be past the threshold
+  report.over.clear();
+  if(stats.maximum <= threshold && stats.minimum >= -threshold) return true;
+  for(unsigned int v=0; v<numVertices; v++){
+    const double value = scratch.values[v];
+    if(value > threshold || value < -threshold) report.over.push_back(v);
+  }
+  return true;
+}
+
+static void writeCsv(FILE* out, int frame, const std::string& path, const FrameReport& report){
+  std::fprintf(out, "%d,\"%s\",%.9g,%.9g,%.9g,%zu,\"", frame, path.c_str(), report.minimum, report.maximum, report.mean, report.over.size());
+  for(size_t i=0; i<report.over.size(); i++){
+    std::fprintf(out, i == 0 ? "%u" : " %u", report.over[i]);
+  }
+  std::fprintf(out, "\"\n");
+}
+
+static std::string jsonEscape(const std::string& text){
+  std::string escaped;
+  for(const char c : text){
+    if(c == '"' || c == '\\') escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
+
+static void writeJson(FILE* out, bool first, int frame, const std::string& path, const FrameReport& report){
+  std::fprintf(out, "%s    {\"frame\": %d, \"file\": \"%s\", \"min\": %.9g, \"max\": %.9g, \"mean\": %.9g, \"overThreshold\": [",
+               first ? "" : ",\n", frame, jsonEscape(path).c_str(), report.minimum, report.maximum, report.mean);
+  for(size_t i=0; i<report.over.size(); i++){
+    std::fprintf(out, i == 0 ? "%u" : ", %u", report.over[i]);
+  }
+  std::fprintf(out, "]}");
+}
+
+static void usage(){
+  std::fprintf(stderr, "usage: stressAnalyze <reference.obj> <frame> [<frame> ...] [-t threads] [-threshold x] [-start n]\n"
+                       "                     [-m multiplier] [-c clampMax] [-n] [-metric edge|area|major|minor] [-format csv|json] [-o file]\n");
+}
+
+int main(int argc, char** argv){
+  std::vector<std::string> files;
+  StressSettings settings;
+  unsigned int numThreads = 0;
+  double threshold = 0.5;
+  int startFrame = 0;
+  bool json = false;
+  std::string outPath;
+  StressMetric metric = kStressEdgeLength;
+
+  for(int a=1; a<argc; a++){
+    const bool hasValue = a + 1 < argc;
+    if(!std::strcmp(argv[a], "-t") && hasValue) numThreads = std::atoi(argv[++a]);
+    else if(!std::strcmp(argv[a], "-threshold") && hasValue) threshold = std::atof(argv[++a]);
+    else if(!std::strcmp(argv[a], "-start") && hasValue) startFrame = std::atoi(argv[++a]);
+    else if(!std::strcmp(argv[a], "-m") && hasValue) settings.multiplier = std::atof(argv[++a]);
+    else if(!std::strcmp(argv[a], "-c") && hasValue) settings.clampMax = std::atof(argv[++a]);
+    else if(!std::strcmp(argv[a], "-n")) settings.normalize = true;
+    else if(!std::strcmp(argv[a], "-format") && hasValue) json = !std::strcmp(argv[++a], "json");
+    else if(!std::strcmp(argv[a], "-metric") && hasValue){
+      const char* name = argv[++a];
+      if(!std::strcmp(name, "area")) metric = kStressArea;
+      else if(!std::strcmp(name, "major")) metric = kStressMajorStrain;
+      else if(!std::strcmp(name, "minor")) metric = kStressMinorStrain;
+      else if(std::strcmp(name, "edge")){
+        usage();
+        return 2;
+      }
+    }
+    else if(!std::strcmp(argv[a], "-o") && hasValue) outPath = argv[++a];
+    else if(argv[a][0] == '-'){
+      usage();
+      return 2;
+    }
+    else files.push_back(argv[a]);
+  }
+  if(files.size() < 2){
+    usage();
+    return 2;
+  }
+
+  //reference topology and rest lengths, shared read only by every thread
+  const Clock::time_point start = Clock::now();
+  StressObjMesh reference;
+  std::string error;
+  if(!stressReadObj(files[0], reference, error)){
+    std::fprintf(stderr, "stressAnalyze: %s\n", error.c_str());
+    return 1;
+  }
+  std::vector<unsigned int> edgeVertices;
+  stressEdgesFromFaces(reference.points.size(), reference.faceCounts, reference.faceConnects, edgeVertices);
+  StressTopology topology;
+  stressBuildTopology(topology, reference.points.size(), edgeVertices.data(), static_cast<unsigned int>(edgeVertices.size() / 2));
+  std::vector<double> invRestLengths;
+  stressBuildRestLengths(topology, reference.points, invRestLengths);
+  StressTriangles triangles;
+  if(metric != kStressEdgeLength){
+    std::vector<unsigned int> triangleVertices;
+    stressTriangulateFaces(reference.faceCounts, reference.faceConnects, reference.points, triangleVertices);
+    stressBuildTriangles(triangles, reference.points.size(), triangleVertices.data(),
+                         static_cast<unsigned int>(triangleVertices.size() / 3), reference.points);
+  }
+
+  FILE* out = outPath.empty() ? stdout : std::fopen(outPath.c_str(), "w");
+  if(!out){
+    std::fprintf(stderr, "stressAnalyze: can't write %s\n", outPath.c_str());
+    return 1;
+  }
+  if(json){
+    std::fprintf(out, "{\n  \"reference\": \"%s\",\n  \"vertices\": %u,\n  \"threshold\": %.9g,\n  \"frames\": [\n",
+                 jsonEscape(files[0]).c_str(), topology.numVertices(), threshold);
+  }
+  else{
+    std::fprintf(out, "frame,file,min,max,mean,over_count,over_vertices\n");
+  }
+
+  //every thread evaluates whole frames serially, finished frames are written in order as soon as
+  //all the frames before them are done, a thread waits before it runs more than window frames ahead
+  const unsigned int numFrames = static_cast<unsigned int>(files.size() - 1);
+  const unsigned int threads = std::min(numFrames, numThreads == 0 ? stressHardwareThreads() : numThreads);
+  const unsigned int window = 2 * threads;
+  settings.numThreads = 1;
+
+  std::mutex lock;
+  std::condition_variable written;
+  std::map<unsigned int, FrameReport> pending;  //finished frames waiting for their turn
+  unsigned int nextFrame = 0;  //next frame a thread picks up
+  unsigned int nextWrite = 0;  //next frame to write
+  unsigned int overFrames = 0;
+  bool failed = false;
+
+  stressParallelFor(threads, 1, threads, [&](unsigned int, unsigned int, unsigned int){
+    FrameScratch scratch;
+    FrameReport report;
+    std::string frameError;
+    for(;;){
+      unsigned int frame;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        written.wait(guard, [&](){ return failed || nextFrame >= numFrames || nextFrame < nextWrite + window; });
+        if(failed || nextFrame >= numFrames) return;
+        frame = nextFrame++;
+      }
+
+      const bool ok = evaluateFrame(files[frame + 1], topology, invRestLengths, triangles, metric, settings, threshold,
+                                    scratch, report, frameError);
+
+      std::lock_guard<std::mutex> guard(lock);
+      if(!ok){
+        if(!failed) std::fprintf(stderr, "stressAnalyze: %s\n", frameError.c_str());
+        failed = true;
+        written.notify_all();
+        return;
+      }
+      pending[frame] = std::move(report);
+      report = FrameReport();
+      while(!pending.empty() && pending.begin()->first == nextWrite){
+        const FrameReport& ready = pending.begin()->second;
+        if(json) writeJson(out, nextWrite == 0, startFrame + static_cast<int>(nextWrite), files[nextWrite + 1], ready);
+        else writeCsv(out, startFrame + static_cast<int>(nextWrite), files[nextWrite + 1], ready);
+        if(!ready.over.empty()) overFrames++;
+        pending.erase(pending.begin());
+        nextWrite++;
+      }
+      written.notify_all();
+    }
+  });
+
+  if(json){
+    std::fprintf(out, "\n  ]\n}\n");
+  }
+  if(out != stdout){
+    std::fclose(out);
+  }
+  if(failed){
+    return 1;
+  }
+
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::fprintf(stderr, "stressAnalyze: %u frames, %u over threshold %g, %u threads, %.3f s\n", numFrames, overFrames, threshold, threads, seconds);
+  return 0;
+}
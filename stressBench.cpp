@@ -0,0 +1,377 @@
+//stressBench.cpp
+//standalone benchmark of the stress core, runs without maya
+//
+//usage: stressBench <reference.obj> <deformed.obj> [-i iterations] [-t threads] [-g grainSize] [-c cache [-e uint8|half]]
+//       stressBench --grid <size> [-i iterations] [-t threads] [-g grainSize] [-c cache [-e uint8|half]]
+//-c bakes the deformed and patched results into a cache file and times reading it back
+//the correctness checks live in stressTests
+
+#include "stressCache.h"
+#include "stressCore.h"
+#include "stressObj.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void printPhase(const char* name, double ms){
+  std::printf("%-14s %10.3f ms\n", name, ms);
+}
+
+//size x size quad grid, the deformed pose is stretched and waved
+static void buildGrid(unsigned int size, StressObjMesh& reference, StressPositions& deformed){
+  const unsigned int numVertices = size * size;
+  reference.points.resize(numVertices);
+  deformed.resize(numVertices);
+
+  for(unsigned int j=0; j<size; j++){
+    for(unsigned int i=0; i<size; i++){
+      const unsigned int v = j * size + i;
+      const double u = static_cast<double>(i) / size;
+      reference.points.x[v] = i;
+      reference.points.y[v] = 0.0;
+      reference.points.z[v] = j;
+      deformed.x[v] = i * (1.0 + 0.3 * u);
+      deformed.y[v] = std::sin(u * 12.0) * 2.0;
+      deformed.z[v] = j * (1.0 - 0.2 * u);
+    }
+  }
+
+  reference.faceCounts.assign((size - 1) * (size - 1), 4);
+  reference.faceConnects.clear();
+  reference.faceConnects.reserve(reference.faceCounts.size() * 4);
+  for(unsigned int j=0; j+1<size; j++){
+    for(unsigned int i=0; i+1<size; i++){
+      const unsigned int v = j * size + i;
+      reference.faceConnects.push_back(v);
+      reference.faceConnects.push_back(v + 1);
+      reference.faceConnects.push_back(v + size + 1);
+      reference.faceConnects.push_back(v + size);
+    }
+  }
+}
+
+static void usage(){
+  std::fprintf(stderr, "usage: stressBench <reference.obj> <deformed.obj> [-i iterations] [-t threads] [-g grainSize] [-c cache [-e uint8|half]]\n"
+                       "       stressBench --grid <size> [-i iterations] [-t threads] [-g grainSize] [-c cache [-e uint8|half]]\n");
+}
+
+int main(int argc, char** argv){
+  std::vector<std::string> files;
+  unsigned int gridSize = 0;
+  unsigned int iterations = 20;
+  StressSettings settings;
+  std::string cachePath;
+  StressCacheEncoding encoding = kStressCacheUint8;
+
+  for(int a=1; a<argc; a++){
+    const bool hasValue = a + 1 < argc;
+    if(!std::strcmp(argv[a], "--grid") && hasValue) gridSize = std::atoi(argv[++a]);
+    else if(!std::strcmp(argv[a], "-i") && hasValue) iterations = std::atoi(argv[++a]);
+    else if(!std::strcmp(argv[a], "-t") && hasValue) settings.numThreads = std::atoi(argv[++a]);
+    else if(!std::strcmp(argv[a], "-g") && hasValue) settings.grainSize = std::atoi(argv[++a]);
+    else if(!std::strcmp(argv[a], "-c") && hasValue) cachePath = argv[++a];
+    else if(!std::strcmp(argv[a], "-e") && hasValue) encoding = !std::strcmp(argv[++a], "half") ? kStressCacheHalf : kStressCacheUint8;
+    else if(argv[a][0] == '-'){
+      usage();
+      return 2;
+    }
+    else files.push_back(argv[a]);
+  }
+  if(iterations == 0) iterations = 1;
+  if((gridSize < 2 && files.size() != 2) || (gridSize >= 2 && !files.empty())){
+    usage();
+    return 2;
+  }
+
+  //load
+  StressObjMesh reference;
+  StressPositions deformed;
+  Clock::time_point start = Clock::now();
+  if(gridSize >= 2){
+    buildGrid(gridSize, reference, deformed);
+  }
+  else{
+    std::string error;
+    if(!stressReadObj(files[0], reference, error) || !stressReadObjPoints(files[1], deformed, error)){
+      std::fprintf(stderr, "stressBench: %s\n", error.c_str());
+      return 1;
+    }
+  }
+  const double loadMs = elapsedMs(start);
+
+  if(deformed.size() != reference.points.size()){
+    std::fprintf(stderr, "stressBench: reference has %u points, deformed has %u\n", reference.points.size(), deformed.size());
+    return 1;
+  }
+
+  //topology
+  start = Clock::now();
+  std::vector<unsigned int> edgeVertices;
+  stressEdgesFromFaces(reference.points.size(), reference.faceCounts, reference.faceConnects, edgeVertices);
+  const double edgesMs = elapsedMs(start);
+
+  StressTopology topology;
+  start = Clock::now();
+  stressBuildTopology(topology, reference.points.size(), edgeVertices.data(), static_cast<unsigned int>(edgeVertices.size() / 2));
+  const double topologyMs = elapsedMs(start);
+
+  std::vector<double> invRestLengths;
+  start = Clock::now();
+  stressBuildRestLengths(topology, reference.points, invRestLengths);
+  const double restMs = elapsedMs(start);
+
+  std::vector<unsigned int> triangleVertices;
+  StressTriangles triangles;
+  start = Clock::now();
+  stressTriangulateFaces(reference.faceCounts, reference.faceConnects, reference.points, triangleVertices);
+  stressBuildTriangles(triangles, reference.points.size(), triangleVertices.data(),
+                       static_cast<unsigned int>(triangleVertices.size() / 3), reference.points);
+  const double trianglesMs = elapsedMs(start);
+
+  const unsigned int numFaces = static_cast<unsigned int>(reference.faceCounts.size());
+  const unsigned int numFaceVertices = static_cast<unsigned int>(reference.faceConnects.size());
+  start = Clock::now();
+  const StressFingerprint fingerprint = stressFingerprint(reference.points.size(), reference.faceCounts.data(), numFaces,
+                                                          reference.faceConnects.data(), numFaceVertices);
+  const double fingerprintMs = elapsedMs(start);
+
+  //kernel, best time of all the iterations
+  const unsigned int numVertices = topology.numVertices();
+  std::vector<double> values(numVertices);
+  StressKernel kernel;
+  double ratiosMs = 1e30;
+  double finalizeMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    start = Clock::now();
+    kernel.computeEdgeRatios(topology, invRestLengths, deformed, settings);
+    const double ratiosIt = elapsedMs(start);
+
+    start = Clock::now();
+    kernel.finalize(topology, settings, values.data());
+    const double finalizeIt = elapsedMs(start);
+
+    if(ratiosIt < ratiosMs) ratiosMs = ratiosIt;
+    if(finalizeIt < finalizeMs) finalizeMs = finalizeIt;
+  }
+
+  //same pass with the stats reduced on the fly
+  StressStats stats;
+  double statsMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    start = Clock::now();
+    kernel.finalize(topology, settings, values.data(), &stats);
+    const double statsIt = elapsedMs(start);
+    if(statsIt < statsMs) statsMs = statsIt;
+  }
+
+  //all three triangle metrics in their fused pass
+  std::vector<double> areaValues(numVertices);
+  std::vector<double> majorValues(numVertices);
+  std::vector<double> minorValues(numVertices);
+  double triangleMetricsMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    start = Clock::now();
+    kernel.computeTriangleMetrics(triangles, deformed, settings, areaValues.data(), majorValues.data(), minorValues.data());
+    const double triangleIt = elapsedMs(start);
+    if(triangleIt < triangleMetricsMs) triangleMetricsMs = triangleIt;
+  }
+
+  //the first tenth of the vertices as a region of interest
+  std::vector<unsigned char> active(numVertices, 0);
+  std::fill(active.begin(), active.begin() + numVertices / 10, 1);
+  StressMask mask;
+  stressBuildMask(mask, topology, active.data());
+  std::vector<double> masked(numVertices, std::numeric_limits<double>::quiet_NaN());
+  StressStats maskedStats;
+  double maskedMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    start = Clock::now();
+    kernel.computeMasked(topology, invRestLengths, deformed, settings, mask, masked.data(), &maskedStats);
+    const double maskedIt = elapsedMs(start);
+    if(maskedIt < maskedMs) maskedMs = maskedIt;
+  }
+
+  //single precision from the interleaved floats maya hands over, against double from the same floats
+  std::vector<float> raw(static_cast<size_t>(numVertices) * 3);
+  for(unsigned int v=0; v<numVertices; v++){
+    raw[3 * v] = static_cast<float>(deformed.x[v]);
+    raw[3 * v + 1] = static_cast<float>(deformed.y[v]);
+    raw[3 * v + 2] = static_cast<float>(deformed.z[v]);
+  }
+  const std::vector<float> invRestFloat(invRestLengths.begin(), invRestLengths.end());
+  StressPositions rawDouble;
+  StressFloatPositions rawFloat;
+  rawDouble.resize(numVertices);
+  rawFloat.resize(numVertices);
+  std::vector<double> doubleValues(numVertices);
+  std::vector<double> floatValues(numVertices);
+  double readDoubleMs = 1e30;
+  double readFloatMs = 1e30;
+  double evaluateFloatMs = 1e30;
+  double evaluateDoubleMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    start = Clock::now();
+    stressLoadPositions(raw.data(), rawDouble, 0, numVertices);
+    readDoubleMs = std::min(readDoubleMs, elapsedMs(start));
+
+    start = Clock::now();
+    kernel.compute(topology, invRestLengths, rawDouble, settings, doubleValues.data());
+    evaluateDoubleMs = std::min(evaluateDoubleMs, elapsedMs(start));
+
+    start = Clock::now();
+    stressLoadPositions(raw.data(), rawFloat, 0, numVertices);
+    readFloatMs = std::min(readFloatMs, elapsedMs(start));
+
+    start = Clock::now();
+    kernel.computeFloat(topology, invRestFloat, rawFloat, settings, floatValues.data());
+    evaluateFloatMs = std::min(evaluateFloatMs, elapsedMs(start));
+  }
+
+  //clusters of the rest pose, their bounds are measured again on every evaluation
+  std::vector<float> restRaw(static_cast<size_t>(numVertices) * 3);
+  for(unsigned int v=0; v<numVertices; v++){
+    restRaw[3 * v] = static_cast<float>(reference.points.x[v]);
+    restRaw[3 * v + 1] = static_cast<float>(reference.points.y[v]);
+    restRaw[3 * v + 2] = static_cast<float>(reference.points.z[v]);
+  }
+  StressClusters clusters;
+  start = Clock::now();
+  stressBuildClusters(clusters, topology, restRaw.data(), 256);
+  const double clustersMs = elapsedMs(start);
+  std::vector<float> clusterBounds;
+  double boundsMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    start = Clock::now();
+    stressClusterBounds(clusters, raw.data(), settings, clusterBounds);
+    boundsMs = std::min(boundsMs, elapsedMs(start));
+  }
+
+  //temporal accumulation of frames made by scaling the values, timed in the window mode over 24 frames
+  const unsigned int numFrames = 30;
+  const unsigned int temporalWindow = 24;
+  auto frameWeight = [](unsigned int f){ return static_cast<double>(static_cast<int>((f * 7) % 11) - 5) / 5.0; };
+  std::vector<double> frameValues(numVertices);
+  std::vector<double> windowValues(numVertices);
+  StressTemporal windowTemporal;
+  double temporalMs = 1e30;  //only frames with a full window count
+  for(unsigned int f=0; f<numFrames; f++){
+    for(unsigned int v=0; v<numVertices; v++){
+      windowValues[v] = values[v] * frameWeight(f);
+    }
+    start = Clock::now();
+    windowTemporal.accumulate(kStressTemporalWindow, temporalWindow, 0.0, true, windowValues.data(), numVertices, settings);
+    if(f + 1 >= temporalWindow) temporalMs = std::min(temporalMs, elapsedMs(start));
+  }
+
+  //laplacian smoothing, one pass should cost about what the edge ratios do
+  StressSettings smoothSettings = settings;
+  smoothSettings.smoothIterations = 10;
+  std::vector<double> smoothedValues(numVertices);
+  double smoothMs = 1e30;
+  for(unsigned int i=0; i<iterations; i++){
+    smoothedValues = values;
+    start = Clock::now();
+    kernel.smooth(topology, smoothSettings, smoothedValues.data());
+    smoothMs = std::min(smoothMs, elapsedMs(start));
+  }
+
+  //incremental pass after moving a small patch, epsilon 0 so the result has to match a full pass
+  StressPositions patched = deformed;
+  const unsigned int patchSize = numVertices / 100 > 0 ? numVertices / 100 : 1;
+  for(unsigned int v=0; v<patchSize && v<numVertices; v++){
+    patched.y[v] += 0.25;
+  }
+  std::vector<double> incremental(numVertices);
+  StressKernel incrementalKernel;
+  StressStats incrementalStats;
+  incrementalKernel.computeIncremental(topology, invRestLengths, deformed, settings, 0.0, incremental.data());
+  start = Clock::now();
+  const unsigned int recomputed = incrementalKernel.computeIncremental(topology, invRestLengths, patched, settings, 0.0,
+                                                                       incremental.data(), &incrementalStats);
+  const double incrementalMs = elapsedMs(start);
+
+  std::vector<double> patchedValues(numVertices);
+  StressStats patchedStats;
+  kernel.compute(topology, invRestLengths, patched, settings, patchedValues.data(), &patchedStats);
+
+  std::printf("mesh           %u vertices, %u edges\n", numVertices, topology.numEdges());
+  std::printf("simd           %s\n", stressSimdLevelName(kernel.simdLevel()));
+  std::printf("threads        %u, grain %u\n", settings.numThreads, settings.grainSize);
+  printPhase("load", loadMs);
+  printPhase("edges", edgesMs);
+  printPhase("topology", topologyMs);
+  printPhase("rest lengths", restMs);
+  printPhase("triangles", trianglesMs);
+  printPhase("fingerprint", fingerprintMs);
+  std::printf("               hash %016llx\n", static_cast<unsigned long long>(fingerprint.hash));
+  printPhase("edge ratios", ratiosMs);
+  printPhase("finalize", finalizeMs);
+  printPhase("evaluate", ratiosMs + finalizeMs);
+  printPhase("finalize+stats", statsMs);
+  printPhase("area+strains", triangleMetricsMs);
+  printPhase("masked 10%", maskedMs);
+  printPhase("read f64", readDoubleMs);
+  printPhase("evaluate f64", evaluateDoubleMs);
+  printPhase("read f32", readFloatMs);
+  printPhase("evaluate f32", evaluateFloatMs);
+  printPhase("clusters", clustersMs);
+  printPhase("cluster bounds", boundsMs);
+  printPhase("window 24", temporalMs);
+  printPhase("smooth x10", smoothMs);
+  printPhase("incremental", incrementalMs);
+  std::printf("               %u of %u vertices recomputed\n", recomputed, numVertices);
+
+  //bake both poses and read them back
+  if(!cachePath.empty()){
+    std::string error;
+    StressCacheWriter writer;
+    start = Clock::now();
+    const bool written = writer.open(cachePath, numVertices, 1, encoding, 0, 0, error) && writer.writeFrame(values.data(), nullptr, error) &&
+                         writer.writeFrame(patchedValues.data(), nullptr, error) && writer.close(error);
+    const double writeMs = elapsedMs(start);
+
+    StressCacheReader reader;
+    if(!written || !reader.open(cachePath, error)){
+      std::fprintf(stderr, "stressBench: %s\n", error.c_str());
+      return 1;
+    }
+
+    std::vector<double> decoded(numVertices);
+    double readMs = 1e30;
+    for(unsigned int i=0; i<iterations; i++){
+      start = Clock::now();
+      reader.readFrame(2, decoded.data());
+      const double readIt = elapsedMs(start);
+      if(readIt < readMs) readMs = readIt;
+    }
+
+    double maxError = 0.0;
+    for(int f=0; f<2; f++){
+      reader.readFrame(f + 1, decoded.data());
+      const std::vector<double>& expectedFrame = f == 0 ? values : patchedValues;
+      for(unsigned int v=0; v<numVertices; v++){
+        maxError = std::max(maxError, std::fabs(decoded[v] - expectedFrame[v]));
+      }
+    }
+
+    const size_t fileSize = sizeof(StressCacheHeader) + 2 * stressCacheFrameSize(numVertices, encoding, 0);
+    printPhase("cache write", writeMs);
+    printPhase("cache read", readMs);
+    std::printf("cache          %s, %zu bytes, max error %g\n", encoding == kStressCacheHalf ? "half" : "uint8", fileSize, maxError);
+  }
+
+  return 0;
+}
@@ -0,0 +1,344 @@
+//stressCache.cpp
+#include "stressCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+static const char kMagic[4] = {'S', 'T', 'R', 'C'};
+static const uint32_t kVersion = 2;  //1 had no cluster bounds
+
+uint16_t stressFloatToHalf(float value){
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t rawExponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  //inf and nan, nan keeps a mantissa bit so it stays a nan
+  if(rawExponent == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+  const int exponent = static_cast<int>(rawExponent) - 127 + 15;
+  if(exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+
+  //too small for a normal half, shift into a subnormal
+  if(exponent <= 0){
+    if(exponent < -10) return static_cast<uint16_t>(sign);
+    mantissa |= 0x800000;
+    const unsigned int shift = static_cast<unsigned int>(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if(rest > halfway || (rest == halfway && (half & 1))) half++;
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  //a carry out of the mantissa correctly bumps the exponent
+  uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1fff;
+  if(rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+  return static_cast<uint16_t>(sign | half);
+}
+
+float stressHalfToFloat(uint16_t value){
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  const uint32_t mantissa = value & 0x3ff;
+
+  uint32_t bits;
+  if(exponent == 0){
+    //zero and subnormals, mantissa * 2^-24
+    const float magnitude = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+    return sign ? -magnitude : magnitude;
+  }
+  else if(exponent == 31){
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else{
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+//every half decoded once, frames are then decoded with a table lookup
+static const std::vector<float>& halfTable(){
+  static const std::vector<float> table = [](){
+    std::vector<float> values(65536);
+    for(unsigned int i=0; i<65536; i++){
+      values[i] = stressHalfToFloat(static_cast<uint16_t>(i));
+    }
+    return values;
+  }();
+  return table;
+}
+
+void stressUint8Range(double low, double high, float& offset, float& scale){
+  offset = static_cast<float>(low);
+  scale = static_cast<float>((high - low) / 255.0);
+}
+
+void stressEncodeUint8(const double* values, unsigned int count, float offset, float scale, unsigned char* encoded){
+  const double invScale = scale > 0.0f ? 1.0 / scale : 0.0;
+  for(unsigned int i=0; i<count; i++){
+    const double q = std::floor((values[i] - offset) * invScale + 0.5);
+    encoded[i] = static_cast<unsigned char>(std::min(255.0, std::max(0.0, q)));
+  }
+}
+
+size_t stressCacheFrameSize(unsigned int vertexCount, StressCacheEncoding encoding, unsigned int clusterCount){
+  const size_t valueBytes = static_cast<size_t>(vertexCount) * (encoding == kStressCacheHalf ? 2 : 1);
+  return (2 + 6 * static_cast<size_t>(clusterCount)) * sizeof(float) + ((valueBytes + 3) & ~static_cast<size_t>(3));
+}
+
+//bytes of a frame's cluster bounds, they sit between its offset and scale and its values
+static size_t boundsBytes(const StressCacheHeader& header){
+  return 6 * static_cast<size_t>(header.clusterCount) * sizeof(float);
+}
+
+StressCacheWriter::StressCacheWriter() : file(nullptr){
+  std::memset(&header, 0, sizeof(header));
+}
+
+StressCacheWriter::~StressCacheWriter(){
+  std::string error;
+  close(error);
+}
+
+bool StressCacheWriter::open(const std::string& path, unsigned int vertexCount, int startFrame, StressCacheEncoding encoding,
+                             unsigned int clusterSize, unsigned int clusterCount, std::string& error){
+  std::string closeError;
+  close(closeError);
+
+  file = std::fopen(path.c_str(), "wb");
+  if(!file){
+    error = "can't write " + path;
+    return false;
+  }
+
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.vertexCount = vertexCount;
+  header.frameCount = 0;
+  header.startFrame = startFrame;
+  header.encoding = encoding;
+  header.clusterSize = clusterSize;
+  header.clusterCount = clusterCount;
+  buffer.assign(stressCacheFrameSize(vertexCount, encoding, clusterCount), 0);
+
+  if(std::fwrite(&header, sizeof(header), 1, file) != 1){
+    error = "can't write " + path;
+    std::fclose(file);
+    file = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool StressCacheWriter::writeFrame(const double* values, const float* clusterBounds, std::string& error){
+  if(!file){
+    error = "cache file is not open";
+    return false;
+  }
+
+  const unsigned int count = header.vertexCount;
+  double low = 0.0;
+  double high = 0.0;
+  if(count != 0){
+    const std::pair<const double*, const double*> range = std::minmax_element(values, values + count);
+    low = *range.first;
+    high = *range.second;
+  }
+
+  //offset and scale are stored as floats, quantize against the stored values so decoding matches
+  float offset;
+  float scale;
+  unsigned char* encoded = buffer.data() + 2 * sizeof(float) + boundsBytes(header);
+  if(header.encoding == kStressCacheHalf){
+    offset = static_cast<float>(0.5 * (low + high));
+    scale = static_cast<float>(0.5 * (high - low));
+    const double invScale = scale > 0.0f ? 1.0 / scale : 0.0;
+    uint16_t* out = reinterpret_cast<uint16_t*>(encoded);
+    for(unsigned int i=0; i<count; i++){
+      const double q = std::min(1.0, std::max(-1.0, (values[i] - offset) * invScale));
+      out[i] = stressFloatToHalf(static_cast<float>(q));
+    }
+  }
+  else{
+    stressUint8Range(low, high, offset, scale);
+    stressEncodeUint8(values, count, offset, scale, encoded);
+  }
+  std::memcpy(buffer.data(), &offset, sizeof(float));
+  std::memcpy(buffer.data() + sizeof(float), &scale, sizeof(float));
+  if(header.clusterCount != 0) std::memcpy(buffer.data() + 2 * sizeof(float), clusterBounds, boundsBytes(header));
+
+  if(std::fwrite(buffer.data(), buffer.size(), 1, file) != 1){
+    error = "can't write cache frame";
+    return false;
+  }
+  header.frameCount++;
+  return true;
+}
+
+bool StressCacheWriter::close(std::string& error){
+  if(!file) return true;
+
+  //patch the final frame count into the header
+  bool ok = std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = (std::fclose(file) == 0) && ok;
+  file = nullptr;
+  if(!ok){
+    error = "can't finish the cache file";
+  }
+  return ok;
+}
+
+StressCacheReader::StressCacheReader() : mapped(nullptr), mappedSize(0){
+  std::memset(&header, 0, sizeof(header));
+#ifdef _WIN32
+  fileHandle = nullptr;
+  mappingHandle = nullptr;
+#endif
+}
+
+StressCacheReader::~StressCacheReader(){
+  close();
+}
+
+bool StressCacheReader::open(const std::string& path, std::string& error){
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE){
+    error = "can't open " + path;
+    return false;
+  }
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(StressCacheHeader))){
+    CloseHandle(file);
+    error = path + " is not a stress cache";
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if(!view){
+    if(mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    error = "can't map " + path;
+    return false;
+  }
+  fileHandle = file;
+  mappingHandle = mapping;
+  mappedSize = static_cast<size_t>(size.QuadPart);
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0){
+    error = "can't open " + path;
+    return false;
+  }
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(StressCacheHeader))){
+    ::close(fd);
+    error = path + " is not a stress cache";
+    return false;
+  }
+  void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);  //the mapping keeps the file alive
+  if(view == MAP_FAILED){
+    error = "can't map " + path;
+    return false;
+  }
+  mappedSize = static_cast<size_t>(info.st_size);
+#endif
+  mapped = static_cast<const unsigned char*>(view);
+
+  //validate before anything reads a frame
+  std::memcpy(&header, mapped, sizeof(header));
+  if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version < kVersion){
+    close();
+    error = path + " was baked by an older version, bake it again";
+    return false;
+  }
+  if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+     header.encoding > kStressCacheHalf){
+    close();
+    error = path + " is not a stress cache";
+    return false;
+  }
+  const size_t frameSize = stressCacheFrameSize(header.vertexCount, encoding(), header.clusterCount);
+  if(header.frameCount == 0 || (mappedSize - sizeof(header)) / frameSize < header.frameCount){
+    close();
+    error = path + " is truncated";
+    return false;
+  }
+  return true;
+}
+
+void StressCacheReader::close(){
+  if(mapped){
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(mapped), mappedSize);
+#endif
+  }
+  mapped = nullptr;
+  mappedSize = 0;
+  std::memset(&header, 0, sizeof(header));
+}
+
+const unsigned char* StressCacheReader::frameRecord(int frame) const{
+  const long long last = static_cast<long long>(header.frameCount) - 1;
+  const long long index = std::min(last, std::max(0ll, static_cast<long long>(frame) - header.startFrame));
+  const size_t frameSize = stressCacheFrameSize(header.vertexCount, encoding(), header.clusterCount);
+  return mapped + sizeof(header) + static_cast<size_t>(index) * frameSize;
+}
+
+void StressCacheReader::readFrame(int frame, double* values) const{
+  if(!mapped) return;
+
+  const unsigned char* record = frameRecord(frame);
+  float offset;
+  float scale;
+  std::memcpy(&offset, record, sizeof(float));
+  std::memcpy(&scale, record + sizeof(float), sizeof(float));
+  const unsigned char* encoded = record + 2 * sizeof(float) + boundsBytes(header);
+
+  const unsigned int count = header.vertexCount;
+  if(header.encoding == kStressCacheHalf){
+    const float* table = halfTable().data();
+    const uint16_t* in = reinterpret_cast<const uint16_t*>(encoded);
+    for(unsigned int i=0; i<count; i++){
+      values[i] = offset + static_cast<double>(table[in[i]]) * scale;
+    }
+  }
+  else{
+    for(unsigned int i=0; i<count; i++){
+      values[i] = offset + static_cast<double>(encoded[i]) * scale;
+    }
+  }
+}
+
+void StressCacheReader::readClusterBounds(int frame, float* clusterBounds) const{
+  if(!mapped || header.clusterCount == 0) return;
+  std::memcpy(clusterBounds, frameRecord(frame) + 2 * sizeof(float), boundsBytes(header));
+}
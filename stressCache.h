@@ -0,0 +1,99 @@
+//stressCache.h
+//baked stress cache: per frame stress values quantized to 8 or 16 bits with a per frame offset and scale
+//and the bounds of the drawn pose's clusters, so playback doesn't need the input mesh for them
+//
+//file layout, native byte order:
+//  header  StressCacheHeader
+//  frames  frameCount times { float offset; float scale; float bounds[6 * clusterCount]; values padded to 4 bytes }
+//a value decodes to offset + q * scale, q is the uint8 or the float16 stored for the vertex
+
+#ifndef stressCache_H
+#define stressCache_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum StressCacheEncoding{
+  kStressCacheUint8 = 0,  //q in [0, 255]
+  kStressCacheHalf  //q in [-1, 1] as float16
+};
+
+struct StressCacheHeader{
+  char magic[4];  //"STRC"
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t frameCount;
+  int32_t startFrame;
+  uint32_t encoding;
+  uint32_t clusterSize;  //clusterSize of the node the bounds were measured with
+  uint32_t clusterCount;  //min xyz, max xyz boxes in every frame
+};
+
+//float16 conversions, round to nearest even
+uint16_t stressFloatToHalf(float value);
+float stressHalfToFloat(uint16_t value);
+
+//uint8 quantization of values in [low, high], value = offset + q * scale
+//the stored float offset and scale are what encoding quantizes against, so decoding matches
+void stressUint8Range(double low, double high, float& offset, float& scale);
+void stressEncodeUint8(const double* values, unsigned int count, float offset, float scale, unsigned char* encoded);
+
+//streams frames to a cache file, the frame count is patched into the header on close
+class StressCacheWriter{
+  public:
+    StressCacheWriter();
+    ~StressCacheWriter();
+
+    bool open(const std::string& path, unsigned int vertexCount, int startFrame, StressCacheEncoding encoding,
+              unsigned int clusterSize, unsigned int clusterCount, std::string& error);
+    //values holds vertexCount entries, clusterBounds 6 * clusterCount
+    bool writeFrame(const double* values, const float* clusterBounds, std::string& error);
+    bool close(std::string& error);
+
+    unsigned int frameCount() const { return header.frameCount; };
+
+  private:
+    FILE* file;
+    StressCacheHeader header;
+    std::vector<unsigned char> buffer;  //one encoded frame
+};
+
+//memory maps a cache file, decoding a frame reads only that frame's pages
+class StressCacheReader{
+  public:
+    StressCacheReader();
+    ~StressCacheReader();
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+    bool isOpen() const { return mapped != nullptr; };
+
+    unsigned int vertexCount() const { return header.vertexCount; };
+    unsigned int frameCount() const { return header.frameCount; };
+    int startFrame() const { return header.startFrame; };
+    StressCacheEncoding encoding() const { return static_cast<StressCacheEncoding>(header.encoding); };
+    unsigned int clusterSize() const { return header.clusterSize; };
+    unsigned int clusterCount() const { return header.clusterCount; };
+
+    //decode a frame into values, frames outside the baked range are clamped to the first or last one
+    void readFrame(int frame, double* values) const;
+    //6 * clusterCount floats of the same frame
+    void readClusterBounds(int frame, float* clusterBounds) const;
+
+  private:
+    StressCacheHeader header;
+    const unsigned char* mapped;
+    const unsigned char* frameRecord(int frame) const;
+    size_t mappedSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+//bytes of one frame record
+size_t stressCacheFrameSize(unsigned int vertexCount, StressCacheEncoding encoding, unsigned int clusterCount);
+
+#endif
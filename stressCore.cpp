@@ -0,0 +1,1149 @@
+//stressCore.cpp
+#include "stressCore.h"
+#include "stressParallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+void StressTopology::clear(){
+  //swap with empty vectors so the memory is actually released
+  std::vector<unsigned int>().swap(offsets);
+  std::vector<unsigned int>().swap(neighbors);
+  std::vector<unsigned int>().swap(neighborEdges);
+  std::vector<unsigned int>().swap(edgeFrom);
+  std::vector<unsigned int>().swap(edgeTo);
+}
+
+void StressMask::clear(){
+  std::vector<unsigned int>().swap(vertices);
+  std::vector<unsigned int>().swap(edges);
+  std::vector<unsigned int>().swap(edgeFrom);
+  std::vector<unsigned int>().swap(edgeTo);
+  std::vector<unsigned int>().swap(lines);
+  std::vector<unsigned int>().swap(support);
+}
+
+void StressClusters::clear(){
+  std::vector<unsigned int>().swap(offsets);
+  std::vector<unsigned int>().swap(vertices);
+  std::vector<unsigned int>().swap(representatives);
+  std::vector<unsigned int>().swap(edgeOffsets);
+  std::vector<unsigned int>().swap(edges);
+  std::vector<unsigned int>().swap(coarseFrom);
+  std::vector<unsigned int>().swap(coarseTo);
+}
+
+void StressTriangles::clear(){
+  std::vector<unsigned int>().swap(vertices);
+  std::vector<double>().swap(restInverse);
+  std::vector<unsigned int>().swap(offsets);
+  std::vector<unsigned int>().swap(vertexTriangles);
+}
+
+void stressBuildTopology(StressTopology& topology, unsigned int numVertices, const unsigned int* edgeVertices, unsigned int numEdges){
+  topology.clear();
+
+  //allocate memory for the arrays
+  topology.offsets.assign(numVertices + 1, 0);
+  topology.neighbors.resize(numEdges * 2);
+  topology.neighborEdges.resize(numEdges * 2);
+  topology.edgeFrom.resize(numEdges);
+  topology.edgeTo.resize(numEdges);
+
+  //store the end points and count the valence of each vertex
+  for(unsigned int e=0; e<numEdges; e++){
+    topology.edgeFrom[e] = edgeVertices[2 * e];
+    topology.edgeTo[e] = edgeVertices[2 * e + 1];
+    topology.offsets[edgeVertices[2 * e] + 1]++;
+    topology.offsets[edgeVertices[2 * e + 1] + 1]++;
+  }
+
+  //turn the valences into offsets
+  for(unsigned int v=0; v<numVertices; v++){
+    topology.offsets[v + 1] += topology.offsets[v];
+  }
+
+  //fill the neighbors, each edge writes both of its ends
+  //walking the edges in order keeps every vertex's neighborEdges sorted
+  std::vector<unsigned int> cursor(topology.offsets.begin(), topology.offsets.end() - 1);
+  for(unsigned int e=0; e<numEdges; e++){
+    const unsigned int vtx1 = topology.edgeFrom[e];
+    const unsigned int vtx2 = topology.edgeTo[e];
+    topology.neighborEdges[cursor[vtx1]] = e;
+    topology.neighbors[cursor[vtx1]++] = vtx2;
+    topology.neighborEdges[cursor[vtx2]] = e;
+    topology.neighbors[cursor[vtx2]++] = vtx1;
+  }
+}
+
+StressFingerprint stressFingerprint(unsigned int numVertices, const unsigned int* faceCounts, unsigned int numFaces,
+                                    const unsigned int* faceConnects, unsigned int numFaceVertices){
+  const StressHashKernel hash = stressHashKernel(stressBestSimdLevel());
+  StressFingerprint fingerprint;
+  fingerprint.numVertices = numVertices;
+  fingerprint.numFaces = numFaces;
+  fingerprint.numFaceVertices = numFaceVertices;
+  fingerprint.hash = hash(faceCounts, numFaces) * 0x9e3779b97f4a7c15ull ^ hash(faceConnects, numFaceVertices);
+  return fingerprint;
+}
+
+uint64_t stressHashPoints(const float* xyz, unsigned int numVertices){
+  static_assert(sizeof(float) == sizeof(unsigned int), "points are hashed as 32 bit words");
+  return stressHashKernel(stressBestSimdLevel())(reinterpret_cast<const unsigned int*>(xyz), 3 * numVertices);
+}
+
+static const char kTopologyMagic[4] = {'S', 'T', 'R', 'T'};
+static const uint32_t kTopologyVersion = 1;
+
+//header, then edgeFrom, edgeTo and the rest lengths of every unique edge
+struct StressTopologyHeader{
+  char magic[4];
+  uint32_t version;
+  uint32_t numVertices;
+  uint32_t numFaces;
+  uint32_t numFaceVertices;
+  uint32_t numEdges;
+  uint64_t hash;
+  uint64_t pointsHash;
+};
+
+void stressWriteTopology(const StressFingerprint& fingerprint, uint64_t pointsHash, const StressTopology& topology,
+                         const std::vector<double>& invRestLengths, std::vector<unsigned char>& bytes){
+  const unsigned int numEdges = topology.numEdges();
+  StressTopologyHeader header;
+  std::memcpy(header.magic, kTopologyMagic, sizeof(kTopologyMagic));
+  header.version = kTopologyVersion;
+  header.numVertices = topology.numVertices();
+  header.numFaces = fingerprint.numFaces;
+  header.numFaceVertices = fingerprint.numFaceVertices;
+  header.numEdges = numEdges;
+  header.hash = fingerprint.hash;
+  header.pointsHash = invRestLengths.size() == numEdges ? pointsHash : 0;
+
+  const size_t edgeBytes = numEdges * sizeof(unsigned int);
+  const size_t restBytes = invRestLengths.size() == numEdges ? numEdges * sizeof(double) : 0;
+  bytes.resize(sizeof(header) + 2 * edgeBytes + restBytes);
+  unsigned char* out = bytes.data();
+  std::memcpy(out, &header, sizeof(header));
+  if(numEdges == 0) return;
+  std::memcpy(out + sizeof(header), topology.edgeFrom.data(), edgeBytes);
+  std::memcpy(out + sizeof(header) + edgeBytes, topology.edgeTo.data(), edgeBytes);
+  if(restBytes != 0){
+    std::memcpy(out + sizeof(header) + 2 * edgeBytes, invRestLengths.data(), restBytes);
+  }
+}
+
+bool stressReadTopology(const unsigned char* bytes, size_t size, StressFingerprint& fingerprint, uint64_t& pointsHash,
+                        StressTopology& topology, std::vector<double>& invRestLengths){
+  StressTopologyHeader header;
+  if(!bytes || size < sizeof(header)) return false;
+  std::memcpy(&header, bytes, sizeof(header));
+  if(std::memcmp(header.magic, kTopologyMagic, sizeof(kTopologyMagic)) != 0 || header.version != kTopologyVersion) return false;
+
+  //the rest lengths are optional, a copy without them has a zero pointsHash
+  const size_t edgeBytes = static_cast<size_t>(header.numEdges) * sizeof(unsigned int);
+  const size_t restBytes = static_cast<size_t>(header.numEdges) * sizeof(double);
+  const bool hasRest = size == sizeof(header) + 2 * edgeBytes + restBytes;
+  if(!hasRest && size != sizeof(header) + 2 * edgeBytes) return false;
+
+  std::vector<unsigned int> edgeVertices(2 * static_cast<size_t>(header.numEdges));
+  const unsigned char* from = bytes + sizeof(header);
+  const unsigned char* to = from + edgeBytes;
+  for(unsigned int e=0; e<header.numEdges; e++){
+    std::memcpy(&edgeVertices[2 * e], from + e * sizeof(unsigned int), sizeof(unsigned int));
+    std::memcpy(&edgeVertices[2 * e + 1], to + e * sizeof(unsigned int), sizeof(unsigned int));
+    if(edgeVertices[2 * e] >= header.numVertices || edgeVertices[2 * e + 1] >= header.numVertices) return false;
+  }
+
+  stressBuildTopology(topology, header.numVertices, edgeVertices.data(), header.numEdges);
+  invRestLengths.resize(hasRest ? header.numEdges : 0);
+  if(hasRest && header.numEdges != 0){
+    std::memcpy(invRestLengths.data(), to + edgeBytes, restBytes);
+  }
+  fingerprint.numVertices = header.numVertices;
+  fingerprint.numFaces = header.numFaces;
+  fingerprint.numFaceVertices = header.numFaceVertices;
+  fingerprint.hash = header.hash;
+  pointsHash = hasRest ? header.pointsHash : 0;
+  return true;
+}
+
+void stressEdgesFromFaces(unsigned int numVertices, const std::vector<unsigned int>& faceCounts,
+                          const std::vector<unsigned int>& faceConnects, std::vector<unsigned int>& edgeVertices){
+  edgeVertices.clear();
+  edgeVertices.reserve(faceConnects.size());
+
+  //every face side is bucketed on its lower vertex, a bucket only holds a vertex's valence
+  //worth of entries so the duplicate check is a short linear scan
+  std::vector<unsigned int> bucketStart(numVertices + 1, 0);
+  unsigned int start = 0;
+  for(const unsigned int count : faceCounts){
+    for(unsigned int i=0; i<count; i++){
+      const unsigned int vtx1 = faceConnects[start + i];
+      const unsigned int vtx2 = faceConnects[start + (i + 1 == count ? 0 : i + 1)];
+      if(vtx1 == vtx2 || vtx1 >= numVertices || vtx2 >= numVertices) continue;
+      bucketStart[(vtx1 < vtx2 ? vtx1 : vtx2) + 1]++;
+    }
+    start += count;
+  }
+  for(unsigned int v=0; v<numVertices; v++){
+    bucketStart[v + 1] += bucketStart[v];
+  }
+
+  std::vector<unsigned int> bucketSize(numVertices, 0);
+  std::vector<unsigned int> buckets(bucketStart[numVertices]);
+  start = 0;
+  for(const unsigned int count : faceCounts){
+    for(unsigned int i=0; i<count; i++){
+      const unsigned int vtx1 = faceConnects[start + i];
+      const unsigned int vtx2 = faceConnects[start + (i + 1 == count ? 0 : i + 1)];
+      if(vtx1 == vtx2 || vtx1 >= numVertices || vtx2 >= numVertices) continue;
+
+      const unsigned int lo = vtx1 < vtx2 ? vtx1 : vtx2;
+      const unsigned int hi = vtx1 < vtx2 ? vtx2 : vtx1;
+      unsigned int* bucket = buckets.data() + bucketStart[lo];
+      unsigned int n = 0;
+      while(n < bucketSize[lo] && bucket[n] != hi) n++;
+
+      //first time we see this edge
+      if(n == bucketSize[lo]){
+        bucket[bucketSize[lo]++] = hi;
+        edgeVertices.push_back(vtx1);
+        edgeVertices.push_back(vtx2);
+      }
+    }
+    start += count;
+  }
+}
+
+void stressBuildRestLengths(const StressTopology& topology, const StressPositions& reference, std::vector<double>& invRestLengths){
+  const unsigned int numEdges = topology.numEdges();
+  invRestLengths.assign(numEdges, 0.0);
+
+  if(reference.size() != topology.numVertices()){
+    return;
+  }
+
+  //same kernel as the evaluation with a reciprocal of 1, then invert
+  std::vector<double> ones(numEdges, 1.0);
+  stressEdgeRatioKernel(kStressScalar)(reference, topology.edgeFrom.data(), topology.edgeTo.data(), ones.data(), invRestLengths.data(), 0, numEdges);
+
+  //store the reciprocal so the compute only multiplies
+  for(unsigned int e=0; e<numEdges; e++){
+    invRestLengths[e] = invRestLengths[e] > 0.0 ? 1.0 / invRestLengths[e] : 0.0;
+  }
+}
+
+void stressBuildMask(StressMask& mask, const StressTopology& topology, const unsigned char* active){
+  const unsigned int numVertices = topology.numVertices();
+  const unsigned int numEdges = topology.numEdges();
+  mask.vertices.clear();
+  mask.edges.clear();
+  mask.edgeFrom.clear();
+  mask.edgeTo.clear();
+  mask.lines.clear();
+  mask.support.clear();
+
+  //compact index of every active vertex, the lines refer to those
+  std::vector<unsigned int> compact(numVertices, 0);
+  for(unsigned int v=0; v<numVertices; v++){
+    if(!active[v]) continue;
+    compact[v] = static_cast<unsigned int>(mask.vertices.size());
+    mask.vertices.push_back(v);
+  }
+
+  std::vector<unsigned char> supported(numVertices, 0);
+  for(unsigned int e=0; e<numEdges; e++){
+    const unsigned int from = topology.edgeFrom[e];
+    const unsigned int to = topology.edgeTo[e];
+    if(!active[from] && !active[to]) continue;
+    supported[from] = 1;
+    supported[to] = 1;
+    mask.edges.push_back(e);
+    mask.edgeFrom.push_back(from);
+    mask.edgeTo.push_back(to);
+    if(active[from] && active[to]){
+      mask.lines.push_back(compact[from]);
+      mask.lines.push_back(compact[to]);
+    }
+  }
+
+  //isolated active vertices have no edges but are still drawn
+  for(unsigned int v=0; v<numVertices; v++){
+    if(supported[v] || active[v]) mask.support.push_back(v);
+  }
+}
+
+namespace{
+  //spreads the low 10 bits of value over every third bit
+  inline uint32_t spreadBits(uint32_t value){
+    value &= 0x3ff;
+    value = (value | (value << 16)) & 0x030000ff;
+    value = (value | (value << 8)) & 0x0300f00f;
+    value = (value | (value << 4)) & 0x030c30c3;
+    value = (value | (value << 2)) & 0x09249249;
+    return value;
+  }
+}
+
+void stressBuildClusters(StressClusters& clusters, const StressTopology& topology, const float* xyz, unsigned int clusterSize){
+  clusters.clear();
+  const unsigned int numVertices = topology.numVertices();
+  const unsigned int numEdges = topology.numEdges();
+  if(numVertices == 0) return;
+  if(clusterSize == 0) clusterSize = 1;
+
+  float low[3] = {xyz[0], xyz[1], xyz[2]};
+  float high[3] = {xyz[0], xyz[1], xyz[2]};
+  for(unsigned int v=1; v<numVertices; v++){
+    for(unsigned int a=0; a<3; a++){
+      low[a] = std::min(low[a], xyz[3 * v + a]);
+      high[a] = std::max(high[a], xyz[3 * v + a]);
+    }
+  }
+  float scale[3];
+  for(unsigned int a=0; a<3; a++){
+    scale[a] = high[a] > low[a] ? 1023.0f / (high[a] - low[a]) : 0.0f;
+  }
+
+  //morton order of the rest positions on a 1024^3 grid, ties keep the vertex order
+  std::vector<std::pair<uint32_t, unsigned int>> keyed(numVertices);
+  for(unsigned int v=0; v<numVertices; v++){
+    uint32_t code = 0;
+    for(unsigned int a=0; a<3; a++){
+      const uint32_t cell = static_cast<uint32_t>(std::min(1023.0f, std::max(0.0f, (xyz[3 * v + a] - low[a]) * scale[a])));
+      code |= spreadBits(cell) << a;
+    }
+    keyed[v] = std::make_pair(code, v);
+  }
+  std::sort(keyed.begin(), keyed.end());
+
+  const unsigned int numClusters = (numVertices + clusterSize - 1) / clusterSize;
+  std::vector<unsigned int> vertexCluster(numVertices);
+  clusters.vertices.resize(numVertices);
+  clusters.offsets.resize(numClusters + 1);
+  for(unsigned int i=0; i<numVertices; i++){
+    clusters.vertices[i] = keyed[i].second;
+    vertexCluster[keyed[i].second] = i / clusterSize;
+  }
+  for(unsigned int c=0; c<=numClusters; c++){
+    clusters.offsets[c] = std::min(c * clusterSize, numVertices);
+  }
+
+  clusters.representatives.resize(numClusters);
+  for(unsigned int c=0; c<numClusters; c++){
+    const unsigned int first = clusters.offsets[c];
+    const unsigned int last = clusters.offsets[c + 1];
+    double centroid[3] = {0.0, 0.0, 0.0};
+    for(unsigned int i=first; i<last; i++){
+      for(unsigned int a=0; a<3; a++) centroid[a] += xyz[3 * clusters.vertices[i] + a];
+    }
+    for(unsigned int a=0; a<3; a++) centroid[a] /= static_cast<double>(last - first);
+    double best = std::numeric_limits<double>::max();
+    for(unsigned int i=first; i<last; i++){
+      const unsigned int v = clusters.vertices[i];
+      double distance = 0.0;
+      for(unsigned int a=0; a<3; a++){
+        const double d = xyz[3 * v + a] - centroid[a];
+        distance += d * d;
+      }
+      if(distance < best){
+        best = distance;
+        clusters.representatives[c] = v;
+      }
+    }
+  }
+
+  //edges by the cluster of their first end, kept in edge order within a cluster
+  clusters.edgeOffsets.assign(numClusters + 1, 0);
+  for(unsigned int e=0; e<numEdges; e++){
+    clusters.edgeOffsets[vertexCluster[topology.edgeFrom[e]] + 1]++;
+  }
+  for(unsigned int c=0; c<numClusters; c++){
+    clusters.edgeOffsets[c + 1] += clusters.edgeOffsets[c];
+  }
+  clusters.edges.resize(numEdges);
+  std::vector<unsigned int> cursor(clusters.edgeOffsets.begin(), clusters.edgeOffsets.end() - 1);
+  std::vector<uint64_t> pairs;
+  for(unsigned int e=0; e<numEdges; e++){
+    const unsigned int from = vertexCluster[topology.edgeFrom[e]];
+    const unsigned int to = vertexCluster[topology.edgeTo[e]];
+    clusters.edges[cursor[from]++] = e;
+    if(from != to) pairs.push_back((static_cast<uint64_t>(std::min(from, to)) << 32) | std::max(from, to));
+  }
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+  clusters.coarseFrom.resize(pairs.size());
+  clusters.coarseTo.resize(pairs.size());
+  for(size_t i=0; i<pairs.size(); i++){
+    clusters.coarseFrom[i] = static_cast<unsigned int>(pairs[i] >> 32);
+    clusters.coarseTo[i] = static_cast<unsigned int>(pairs[i] & 0xffffffffu);
+  }
+}
+
+void stressClusterBounds(const StressClusters& clusters, const float* xyz, const StressSettings& settings, std::vector<float>& bounds){
+  const unsigned int numClusters = clusters.numClusters();
+  bounds.resize(6 * static_cast<size_t>(numClusters));
+  if(numClusters == 0) return;
+  //the grain counts clusters, scale it down so a task still covers about grainSize vertices
+  const unsigned int clusterSize = std::max(1u, clusters.offsets[1] - clusters.offsets[0]);
+  const unsigned int grainSize = std::max(1u, settings.grainSize / clusterSize);
+  stressParallelFor(numClusters, grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    for(unsigned int c=begin; c<end; c++){
+      float* box = &bounds[6 * static_cast<size_t>(c)];
+      const unsigned int first = clusters.vertices[clusters.offsets[c]];
+      for(unsigned int a=0; a<3; a++){
+        box[a] = xyz[3 * first + a];
+        box[a + 3] = xyz[3 * first + a];
+      }
+      for(unsigned int i=clusters.offsets[c]+1; i<clusters.offsets[c+1]; i++){
+        const float* p = xyz + 3 * clusters.vertices[i];
+        for(unsigned int a=0; a<3; a++){
+          box[a] = std::min(box[a], p[a]);
+          box[a + 3] = std::max(box[a + 3], p[a]);
+        }
+      }
+    }
+  });
+}
+
+void stressClassifyClusters(const std::vector<float>& bounds, const double* viewProjection, double width, double height,
+                            bool cull, double lodPixels, unsigned char* states){
+  const double* m = viewProjection;
+  const size_t numClusters = bounds.size() / 6;
+  for(size_t c=0; c<numClusters; c++){
+    const float* box = &bounds[6 * c];
+    unsigned int outside[6] = {0, 0, 0, 0, 0, 0};
+    bool behind = false;
+    double low[2] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+    double high[2] = {-std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()};
+    for(unsigned int corner=0; corner<8; corner++){
+      const double x = box[(corner & 1) ? 3 : 0];
+      const double y = box[(corner & 2) ? 4 : 1];
+      const double z = box[(corner & 4) ? 5 : 2];
+      const double cx = x * m[0] + y * m[4] + z * m[8] + m[12];
+      const double cy = x * m[1] + y * m[5] + z * m[9] + m[13];
+      const double cz = x * m[2] + y * m[6] + z * m[10] + m[14];
+      const double cw = x * m[3] + y * m[7] + z * m[11] + m[15];
+      if(cx < -cw) outside[0]++;
+      if(cx > cw) outside[1]++;
+      if(cy < -cw) outside[2]++;
+      if(cy > cw) outside[3]++;
+      if(cz < -cw) outside[4]++;
+      if(cz > cw) outside[5]++;
+      if(cw <= 0.0){
+        behind = true;
+        continue;
+      }
+      low[0] = std::min(low[0], cx / cw);
+      low[1] = std::min(low[1], cy / cw);
+      high[0] = std::max(high[0], cx / cw);
+      high[1] = std::max(high[1], cy / cw);
+    }
+
+    //culled when every corner is past the same clip plane, corners behind the eye make the screen size meaningless
+    bool culled = false;
+    for(unsigned int plane=0; plane<6; plane++){
+      if(outside[plane] == 8) culled = true;
+    }
+    if(cull && culled){
+      states[c] = kStressClusterCulled;
+    } else if(lodPixels > 0.0 && !behind &&
+              std::max((high[0] - low[0]) * 0.5 * width, (high[1] - low[1]) * 0.5 * height) < lodPixels){
+      states[c] = kStressClusterCoarse;
+    } else {
+      states[c] = kStressClusterFull;
+    }
+  }
+}
+
+void stressClusterLines(const StressClusters& clusters, const StressTopology& topology, const unsigned char* states,
+                        std::vector<unsigned int>& lines){
+  lines.clear();
+  for(unsigned int c=0; c<clusters.numClusters(); c++){
+    if(states[c] != kStressClusterFull) continue;
+    for(unsigned int i=clusters.edgeOffsets[c]; i<clusters.edgeOffsets[c+1]; i++){
+      const unsigned int e = clusters.edges[i];
+      lines.push_back(topology.edgeFrom[e]);
+      lines.push_back(topology.edgeTo[e]);
+    }
+  }
+  for(size_t i=0; i<clusters.coarseFrom.size(); i++){
+    const unsigned char from = states[clusters.coarseFrom[i]];
+    const unsigned char to = states[clusters.coarseTo[i]];
+    if(from == kStressClusterCulled || to == kStressClusterCulled) continue;
+    if(from != kStressClusterCoarse && to != kStressClusterCoarse) continue;
+    lines.push_back(clusters.representatives[clusters.coarseFrom[i]]);
+    lines.push_back(clusters.representatives[clusters.coarseTo[i]]);
+  }
+}
+
+void stressClusterPoints(const StressClusters& clusters, const unsigned char* states, std::vector<unsigned int>& points){
+  points.clear();
+  for(unsigned int c=0; c<clusters.numClusters(); c++){
+    if(states[c] == kStressClusterFull){
+      points.insert(points.end(), clusters.vertices.begin() + clusters.offsets[c], clusters.vertices.begin() + clusters.offsets[c + 1]);
+    }
+    else if(states[c] == kStressClusterCoarse){
+      points.push_back(clusters.representatives[c]);
+    }
+  }
+}
+
+//twice the area of abc along n, negative when abc turns the other way than the face
+static double faceTurn(const StressPositions& points, const double* n, unsigned int a, unsigned int b, unsigned int c){
+  const double ab[3] = {points.x[b] - points.x[a], points.y[b] - points.y[a], points.z[b] - points.z[a]};
+  const double ac[3] = {points.x[c] - points.x[a], points.y[c] - points.y[a], points.z[c] - points.z[a]};
+  return (ab[1] * ac[2] - ab[2] * ac[1]) * n[0] + (ab[2] * ac[0] - ab[0] * ac[2]) * n[1] + (ab[0] * ac[1] - ab[1] * ac[0]) * n[2];
+}
+
+void stressTriangulateFaces(const std::vector<unsigned int>& faceCounts, const std::vector<unsigned int>& faceConnects,
+                            const StressPositions& points, std::vector<unsigned int>& triangleVertices){
+  triangleVertices.clear();
+  std::vector<unsigned int> remaining;
+  unsigned int start = 0;
+  for(const unsigned int count : faceCounts){
+    const unsigned int* face = &faceConnects[start];
+    start += count;
+    if(count < 3) continue;
+
+    //newell normal, it stays meaningful for faces that aren't quite planar
+    double n[3] = {0.0, 0.0, 0.0};
+    for(unsigned int i=0; i<count; i++){
+      const unsigned int a = face[i];
+      const unsigned int b = face[(i + 1) % count];
+      n[0] += (points.y[a] - points.y[b]) * (points.z[a] + points.z[b]);
+      n[1] += (points.z[a] - points.z[b]) * (points.x[a] + points.x[b]);
+      n[2] += (points.x[a] - points.x[b]) * (points.y[a] + points.y[b]);
+    }
+
+    //ears are looked for from the second corner on, so a convex face comes out as the fan of its first vertex
+    //and a concave one never gets a triangle outside of it, a face without ears (collinear, twisted) is fanned
+    remaining.assign(face, face + count);
+    while(remaining.size() > 3){
+      const size_t size = remaining.size();
+      bool clipped = false;
+      for(size_t k=1; k<=size && !clipped; k++){
+        const size_t p = k % size;
+        const unsigned int a = remaining[(p + size - 1) % size];
+        const unsigned int b = remaining[p];
+        const unsigned int c = remaining[(p + 1) % size];
+        if(faceTurn(points, n, a, b, c) <= 0.0) continue;
+        bool empty = true;
+        for(size_t q=0; q<size && empty; q++){
+          const unsigned int v = remaining[q];
+          if(v == a || v == b || v == c) continue;
+          empty = faceTurn(points, n, a, b, v) < 0.0 || faceTurn(points, n, b, c, v) < 0.0 || faceTurn(points, n, c, a, v) < 0.0;
+        }
+        if(!empty) continue;
+        triangleVertices.insert(triangleVertices.end(), {a, b, c});
+        remaining.erase(remaining.begin() + p);
+        clipped = true;
+      }
+      if(!clipped) break;
+    }
+    for(size_t i=1; i+1<remaining.size(); i++){
+      triangleVertices.insert(triangleVertices.end(), {remaining[0], remaining[i], remaining[i + 1]});
+    }
+  }
+}
+
+void stressBuildTriangles(StressTriangles& triangles, unsigned int numVertices, const unsigned int* triangleVertices,
+                          unsigned int numTriangles, const StressPositions& reference){
+  triangles.clear();
+  triangles.vertices.assign(triangleVertices, triangleVertices + 3 * numTriangles);
+  triangles.restInverse.assign(3 * numTriangles, 0.0);
+  triangles.offsets.assign(numVertices + 1, 0);
+
+  //vertex to triangle adjacency, filled in triangle order so every list ends up sorted
+  for(unsigned int i=0; i<3*numTriangles; i++){
+    if(triangleVertices[i] < numVertices) triangles.offsets[triangleVertices[i] + 1]++;
+  }
+  for(unsigned int v=0; v<numVertices; v++){
+    triangles.offsets[v + 1] += triangles.offsets[v];
+  }
+  triangles.vertexTriangles.resize(triangles.offsets[numVertices]);
+  std::vector<unsigned int> cursor(triangles.offsets.begin(), triangles.offsets.end() - 1);
+  for(unsigned int i=0; i<3*numTriangles; i++){
+    if(triangleVertices[i] < numVertices) triangles.vertexTriangles[cursor[triangleVertices[i]]++] = i / 3;
+  }
+
+  if(reference.size() != numVertices){
+    return;
+  }
+
+  //the rest edges expressed in a 2d frame of the triangle's plane, x along the first edge,
+  //which makes the edge matrix, and its inverse, upper triangular
+  for(unsigned int t=0; t<numTriangles; t++){
+    const unsigned int a = triangleVertices[3 * t];
+    const unsigned int b = triangleVertices[3 * t + 1];
+    const unsigned int c = triangleVertices[3 * t + 2];
+    if(a >= numVertices || b >= numVertices || c >= numVertices) continue;
+
+    const double e1[3] = {reference.x[b] - reference.x[a], reference.y[b] - reference.y[a], reference.z[b] - reference.z[a]};
+    const double e2[3] = {reference.x[c] - reference.x[a], reference.y[c] - reference.y[a], reference.z[c] - reference.z[a]};
+    const double length1 = std::sqrt(e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]);
+    const double normal[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+    const double doubleArea = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if(length1 <= 0.0 || doubleArea <= 0.0) continue;
+
+    //rest matrix [[length1, e2x], [0, e2y]] with e2y = doubleArea / length1
+    const double e2x = (e1[0] * e2[0] + e1[1] * e2[1] + e1[2] * e2[2]) / length1;
+    triangles.restInverse[3 * t] = 1.0 / length1;
+    triangles.restInverse[3 * t + 1] = -e2x / doubleArea;
+    triangles.restInverse[3 * t + 2] = length1 / doubleArea;
+  }
+}
+
+//remap a ratio from 0 to 2 range to -1 to 1 range, scaled and clamped
+static inline double remapStress(double value, const StressSettings& settings){
+  value -= 1;  //remap the value from 0 to 2 range to -1 to 1 range
+  value *= settings.multiplier;  //multiply value by the multiplier
+
+  if (settings.normalize == 1 && value > settings.clampMax) value = settings.clampMax;  //clamp the value
+
+  return value;
+}
+
+//average of the edge ratios of one vertex, remapped and clamped, float ratios are summed in doubles
+template<typename Ratio>
+static inline double finalizeVertex(unsigned int v, const unsigned int* offsets, const unsigned int* neighborEdges,
+                                    const Ratio* ratios, const StressSettings& settings){
+  double value = 0;
+  for(unsigned int n=offsets[v]; n<offsets[v+1]; n++){
+    value += ratios[neighborEdges[n]];
+  } //end of n loop
+
+  //average the full value by the number of edges
+  const unsigned int valence = offsets[v+1] - offsets[v];
+  value = valence != 0 ? value / static_cast<double>(valence) : 1.0;
+
+  return remapStress(value, settings);
+}
+
+//area ratio, major and minor stretch of one triangle from its deformation gradient F = Ds * Dm^-1
+//the stretches are the square roots of the eigenvalues of the 2x2 right Cauchy-Green tensor F^T F
+static inline void measureTriangle(const double* x, const double* y, const double* z, const unsigned int* vertices,
+                                   const double* restInverse, double* metrics){
+  const double m00 = restInverse[0];
+  const double m01 = restInverse[1];
+  const double m11 = restInverse[2];
+  if(m00 == 0.0){
+    metrics[0] = metrics[1] = metrics[2] = 1.0;  //degenerated at rest, doesn't count as stressed
+    return;
+  }
+
+  const unsigned int a = vertices[0];
+  const unsigned int b = vertices[1];
+  const unsigned int c = vertices[2];
+  const double d1x = x[b] - x[a], d1y = y[b] - y[a], d1z = z[b] - z[a];
+  const double d2x = x[c] - x[a], d2y = y[c] - y[a], d2z = z[c] - z[a];
+
+  //columns of F, the rest inverse has nothing below the diagonal
+  const double f1x = d1x * m00, f1y = d1y * m00, f1z = d1z * m00;
+  const double f2x = d1x * m01 + d2x * m11, f2y = d1y * m01 + d2y * m11, f2z = d1z * m01 + d2z * m11;
+
+  const double c11 = f1x * f1x + f1y * f1y + f1z * f1z;
+  const double c12 = f1x * f2x + f1y * f2y + f1z * f2z;
+  const double c22 = f2x * f2x + f2y * f2y + f2z * f2z;
+
+  const double det = std::max(0.0, c11 * c22 - c12 * c12);
+  const double halfTrace = 0.5 * (c11 + c22);
+  const double halfDiff = 0.5 * (c11 - c22);
+  const double eigenMax = halfTrace + std::sqrt(halfDiff * halfDiff + c12 * c12);
+  const double eigenMin = eigenMax > 0.0 ? det / eigenMax : 0.0;  //no cancellation when the triangle is squashed flat
+
+  metrics[0] = std::sqrt(det);
+  metrics[1] = std::sqrt(eigenMax);
+  metrics[2] = std::sqrt(eigenMin);
+}
+
+double StressStats::autoScale() const{
+  const double largest = std::max(std::fabs(minimum), std::fabs(maximum));
+  return largest > 0.0 ? 1.0 / largest : 1.0;
+}
+
+//one value into a chunk's partial stats, mean collects the sum
+static inline void accumulateStats(StressStats& partial, double value, double range, double bucketScale){
+  partial.minimum = value < partial.minimum ? value : partial.minimum;
+  partial.maximum = value > partial.maximum ? value : partial.maximum;
+  partial.mean += value;
+
+  const double position = (value + range) * bucketScale;
+  const unsigned int bucket = position <= 0.0 ? 0 :
+                              (position >= kStressHistogramBuckets ? kStressHistogramBuckets - 1 : static_cast<unsigned int>(position));
+  partial.histogram[bucket]++;
+}
+
+static inline void resetStats(StressStats& partial){
+  partial = StressStats();
+  partial.minimum = std::numeric_limits<double>::infinity();
+  partial.maximum = -std::numeric_limits<double>::infinity();
+}
+
+StressKernel::StressKernel() : cacheValid(false), stamp(0){
+  setSimdLevel(stressBestSimdLevel());
+}
+
+void StressKernel::setSimdLevel(StressSimdLevel simd){
+  level = simd > stressBestSimdLevel() ? stressBestSimdLevel() : simd;
+  edgeKernel = stressEdgeRatioKernel(level);
+  edgeFloatKernel = stressEdgeRatioFloatKernel(level);
+  detectKernel = stressDetectKernel(level);
+}
+
+void StressKernel::compute(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                           const StressPositions& points, const StressSettings& settings, double* values, StressStats* stats){
+  computeEdgeRatios(topology, invRestLengths, points, settings);
+  finalize(topology, settings, values, stats);
+  cacheValid = false;
+}
+
+unsigned int StressKernel::computeIncremental(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                                              const StressPositions& points, const StressSettings& settings, double epsilon,
+                                              double* values, StressStats* stats){
+  const unsigned int numVertices = topology.numVertices();
+  const unsigned int numEdges = topology.numEdges();
+  const bool sameSettings = previousSettings.multiplier == settings.multiplier &&
+                            previousSettings.clampMax == settings.clampMax &&
+                            previousSettings.normalize == settings.normalize &&
+                            previousSettings.histogramRange == settings.histogramRange;
+
+  //nothing usable cached, evaluate everything and remember where we started from
+  if(!cacheValid || !sameSettings || previous.size() != numVertices || edgeRatios.size() != numEdges){
+    compute(topology, invRestLengths, points, settings, values, stats);
+    previous = points;
+    previousSettings = settings;
+    moved.assign(numVertices, 0);
+    edgeStamp.assign(numEdges, 0);
+    vertexStamp.assign(numVertices, 0);
+    stamp = 0;
+    cacheValid = true;
+    return numVertices;
+  }
+
+  //flag the moved vertices, previous follows them so slow drifts still add up past epsilon
+  std::atomic<unsigned int> numMoved(0);
+  const StressDetectKernel detect = detectKernel;
+  stressParallelFor(numVertices, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    numMoved += detect(points, previous, epsilon, moved.data(), begin, end);
+  });
+
+  if(numMoved == 0){
+    return 0;
+  }
+
+  //past a quarter of the mesh the full streaming pass is cheaper than walking the rings
+  if(numMoved * 4 > numVertices){
+    computeEdgeRatios(topology, invRestLengths, points, settings);
+    finalize(topology, settings, values, stats);
+    previous = points;
+    return numVertices;
+  }
+
+  //stamps avoid clearing the flags between evaluations
+  if(++stamp == 0){
+    std::fill(edgeStamp.begin(), edgeStamp.end(), 0);
+    std::fill(vertexStamp.begin(), vertexStamp.end(), 0);
+    stamp = 1;
+  }
+
+  const unsigned int* offsets = topology.offsets.data();
+  const unsigned int* neighbors = topology.neighbors.data();
+  const unsigned int* neighborEdges = topology.neighborEdges.data();
+  const unsigned int* edgeFrom = topology.edgeFrom.data();
+  const unsigned int* edgeTo = topology.edgeTo.data();
+  double* ratios = edgeRatios.data();
+
+  //re-measure the edges of every moved vertex and queue its one ring
+  touched.clear();
+  for(unsigned int v=0; v<numVertices; v++){
+    if(!moved[v]) continue;
+
+    if(vertexStamp[v] != stamp){
+      vertexStamp[v] = stamp;
+      touched.push_back(v);
+    }
+
+    for(unsigned int n=offsets[v]; n<offsets[v+1]; n++){
+      const unsigned int e = neighborEdges[n];
+      if(edgeStamp[e] != stamp){
+        edgeStamp[e] = stamp;
+        edgeKernel(points, edgeFrom, edgeTo, invRestLengths.data(), ratios, e, e + 1);
+      }
+
+      const unsigned int u = neighbors[n];
+      if(vertexStamp[u] != stamp){
+        vertexStamp[u] = stamp;
+        touched.push_back(u);
+      }
+    } //end of n loop
+  }
+
+  //the rest of values keeps what the previous evaluation wrote
+  const unsigned int numTouched = static_cast<unsigned int>(touched.size());
+  stressParallelFor(numTouched, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    for(unsigned int t=begin; t<end; t++){
+      values[touched[t]] = finalizeVertex(touched[t], offsets, neighborEdges, ratios, settings);
+    }
+  });
+
+  //the untouched values still count, so the stats take one streaming sweep
+  if(stats){
+    computeStats(values, numVertices, settings, *stats);
+  }
+
+  return numTouched;
+}
+
+void StressKernel::computeMasked(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                                 const StressPositions& points, const StressSettings& settings, const StressMask& mask,
+                                 double* values, StressStats* stats){
+  const unsigned int numMaskEdges = static_cast<unsigned int>(mask.edges.size());
+  const unsigned int numMaskVertices = static_cast<unsigned int>(mask.vertices.size());
+  const unsigned int* maskEdges = mask.edges.data();
+  const unsigned int* maskVertices = mask.vertices.data();
+  const unsigned int* offsets = topology.offsets.data();
+  const unsigned int* neighborEdges = topology.neighborEdges.data();
+  const StressEdgeRatioKernel kernel = edgeKernel;
+
+  //the packed edges run through the same vector kernel, their ratios are then scattered
+  //to the slots the per vertex gather reads, edges outside the mask are never touched
+  edgeRatios.resize(topology.numEdges());
+  maskRestLengths.resize(numMaskEdges);
+  maskRatios.resize(numMaskEdges);
+  double* ratios = edgeRatios.data();
+  stressParallelFor(numMaskEdges, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    for(unsigned int i=begin; i<end; i++){
+      maskRestLengths[i] = invRestLengths[maskEdges[i]];
+    }
+    kernel(points, mask.edgeFrom.data(), mask.edgeTo.data(), maskRestLengths.data(), maskRatios.data(), begin, end);
+    for(unsigned int i=begin; i<end; i++){
+      ratios[maskEdges[i]] = maskRatios[i];
+    }
+  });
+
+  if(!stats){
+    stressParallelFor(numMaskVertices, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+      for(unsigned int i=begin; i<end; i++){
+        values[maskVertices[i]] = finalizeVertex(maskVertices[i], offsets, neighborEdges, ratios, settings);
+      }
+    });
+  }
+  else{
+    const double range = settings.histogramRange > 0.0 ? settings.histogramRange : 1.0;
+    const double bucketScale = kStressHistogramBuckets / (2.0 * range);
+    const unsigned int grainSize = settings.grainSize > 0 ? settings.grainSize : 1;
+    const unsigned int numChunks = numMaskVertices / grainSize + (numMaskVertices % grainSize != 0 ? 1 : 0);
+    partials.resize(numChunks);
+
+    stressParallelFor(numMaskVertices, grainSize, settings.numThreads, [&](unsigned int chunk, unsigned int begin, unsigned int end){
+      StressStats& partial = partials[chunk];
+      resetStats(partial);
+      for(unsigned int i=begin; i<end; i++){
+        const double value = finalizeVertex(maskVertices[i], offsets, neighborEdges, ratios, settings);
+        values[maskVertices[i]] = value;
+        accumulateStats(partial, value, range, bucketScale);
+      }
+    });
+    mergeStats(numChunks, numMaskVertices, *stats);
+  }
+  cacheValid = false;  //the ratios of the edges outside the mask are stale
+}
+
+void StressKernel::computeTriangleMetrics(const StressTriangles& triangles, const StressPositions& points, const StressSettings& settings,
+                                          double* area, double* majorStrain, double* minorStrain,
+                                          StressMetric statsMetric, StressStats* stats){
+  const unsigned int numTriangles = triangles.numTriangles();
+  const unsigned int numVertices = triangles.empty() ? 0 : static_cast<unsigned int>(triangles.offsets.size() - 1);
+  const unsigned int* vertices = triangles.vertices.data();
+  const double* restInverse = triangles.restInverse.data();
+  const double* x = points.x.data();
+  const double* y = points.y.data();
+  const double* z = points.z.data();
+
+  //every metric of a triangle comes out of the same gradient, so they are all written in one pass
+  triangleMetrics.resize(3 * numTriangles);
+  double* metrics = triangleMetrics.data();
+  stressParallelFor(numTriangles, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    for(unsigned int t=begin; t<end; t++){
+      measureTriangle(x, y, z, vertices + 3 * t, restInverse + 3 * t, metrics + 3 * t);
+    }
+  });
+
+  //then one gather per vertex averages all three, reducing the stats of one of them on the way
+  const unsigned int* offsets = triangles.offsets.data();
+  const unsigned int* vertexTriangles = triangles.vertexTriangles.data();
+  const unsigned int statsIndex = statsMetric == kStressMajorStrain ? 1 : (statsMetric == kStressMinorStrain ? 2 : 0);
+  const double range = settings.histogramRange > 0.0 ? settings.histogramRange : 1.0;
+  const double bucketScale = kStressHistogramBuckets / (2.0 * range);
+  const unsigned int grainSize = settings.grainSize > 0 ? settings.grainSize : 1;
+  const unsigned int numChunks = numVertices / grainSize + (numVertices % grainSize != 0 ? 1 : 0);
+  if(stats) partials.resize(numChunks);
+
+  stressParallelFor(numVertices, grainSize, settings.numThreads, [&](unsigned int chunk, unsigned int begin, unsigned int end){
+    if(stats) resetStats(partials[chunk]);
+    for(unsigned int v=begin; v<end; v++){
+      double sum[3] = {0.0, 0.0, 0.0};
+      for(unsigned int n=offsets[v]; n<offsets[v+1]; n++){
+        const double* triangle = metrics + 3 * vertexTriangles[n];
+        sum[0] += triangle[0];
+        sum[1] += triangle[1];
+        sum[2] += triangle[2];
+      }
+
+      const unsigned int valence = offsets[v+1] - offsets[v];
+      const double inverseValence = valence != 0 ? 1.0 / static_cast<double>(valence) : 0.0;
+      double value[3];
+      for(unsigned int m=0; m<3; m++){
+        value[m] = remapStress(valence != 0 ? sum[m] * inverseValence : 1.0, settings);
+      }
+
+      if(area) area[v] = value[0];
+      if(majorStrain) majorStrain[v] = value[1];
+      if(minorStrain) minorStrain[v] = value[2];
+      if(stats) accumulateStats(partials[chunk], value[statsIndex], range, bucketScale);
+    } //end of v loop
+  });
+
+  if(stats){
+    mergeStats(numChunks, numVertices, *stats);
+  }
+}
+
+void StressKernel::computeFloat(const StressTopology& topology, const std::vector<float>& invRestLengths,
+                                const StressFloatPositions& points, const StressSettings& settings, double* values, StressStats* stats){
+  const unsigned int numEdges = topology.numEdges();
+  const unsigned int* edgeFrom = topology.edgeFrom.data();
+  const unsigned int* edgeTo = topology.edgeTo.data();
+  const float* invRest = invRestLengths.data();
+  const StressEdgeRatioFloatKernel kernel = edgeFloatKernel;
+
+  edgeFloatRatios.resize(numEdges);
+  float* ratios = edgeFloatRatios.data();
+  stressParallelFor(numEdges, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    kernel(points, edgeFrom, edgeTo, invRest, ratios, begin, end);
+  });
+
+  finalizeRatios(topology, settings, ratios, values, stats);
+  cacheValid = false;  //edgeRatios doesn't hold these
+}
+
+void StressKernel::smooth(const StressTopology& topology, const StressSettings& settings, double* values, StressStats* stats){
+  const unsigned int numVertices = topology.numVertices();
+  const unsigned int iterations = settings.smoothIterations;
+  if(iterations == 0 || numVertices == 0) return;
+  smoothed.resize(numVertices);
+
+  //an odd count starts from a copy so the last pass lands in values
+  double* from = values;
+  double* to = smoothed.data();
+  if(iterations % 2 == 1){
+    std::copy(values, values + numVertices, smoothed.data());
+    std::swap(from, to);
+  }
+
+  const unsigned int* offsets = topology.offsets.data();
+  const unsigned int* neighbors = topology.neighbors.data();
+  const double strength = settings.smoothStrength;
+  //every pass is one loop on the pool's workers, which only wakes them, the passes allocate and start nothing
+  for(unsigned int i=0; i<iterations; i++){
+    stressParallelFor(numVertices, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+      for(unsigned int v=begin; v<end; v++){
+        const unsigned int first = offsets[v];
+        const unsigned int last = offsets[v + 1];
+        double sum = 0.0;
+        for(unsigned int n=first; n<last; n++){
+          sum += from[neighbors[n]];
+        }
+        to[v] = last != first ? from[v] + strength * (sum / (last - first) - from[v]) : from[v];
+      }
+    });
+    std::swap(from, to);
+  }
+
+  if(stats) computeStats(values, numVertices, settings, *stats);
+}
+
+void StressKernel::computeStats(const double* values, unsigned int count, const StressSettings& settings, StressStats& stats){
+  const double range = settings.histogramRange > 0.0 ? settings.histogramRange : 1.0;
+  const double bucketScale = kStressHistogramBuckets / (2.0 * range);
+  const unsigned int grainSize = settings.grainSize > 0 ? settings.grainSize : 1;
+  const unsigned int numChunks = count / grainSize + (count % grainSize != 0 ? 1 : 0);
+  partials.resize(numChunks);
+
+  stressParallelFor(count, grainSize, settings.numThreads, [&](unsigned int chunk, unsigned int begin, unsigned int end){
+    StressStats& partial = partials[chunk];
+    resetStats(partial);
+    for(unsigned int v=begin; v<end; v++){
+      accumulateStats(partial, values[v], range, bucketScale);
+    }
+  });
+
+  mergeStats(numChunks, count, stats);
+}
+
+void StressKernel::mergeStats(unsigned int numChunks, unsigned int count, StressStats& stats) const{
+  //chunks are merged in order so the sum, and the mean, doesn't depend on the thread count
+  stats = StressStats();
+  if(numChunks == 0) return;
+
+  stats.minimum = partials[0].minimum;
+  stats.maximum = partials[0].maximum;
+  double sum = 0.0;
+  for(unsigned int c=0; c<numChunks; c++){
+    const StressStats& partial = partials[c];
+    stats.minimum = partial.minimum < stats.minimum ? partial.minimum : stats.minimum;
+    stats.maximum = partial.maximum > stats.maximum ? partial.maximum : stats.maximum;
+    sum += partial.mean;
+    for(unsigned int b=0; b<kStressHistogramBuckets; b++){
+      stats.histogram[b] += partial.histogram[b];
+    }
+  }
+  stats.count = count;
+  stats.mean = sum / count;
+}
+
+void StressKernel::computeEdgeRatios(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                                     const StressPositions& points, const StressSettings& settings){
+  const unsigned int numEdges = topology.numEdges();
+  const unsigned int* edgeFrom = topology.edgeFrom.data();
+  const unsigned int* edgeTo = topology.edgeTo.data();
+  const double* invRest = invRestLengths.data();
+  const StressEdgeRatioKernel kernel = edgeKernel;
+
+  edgeRatios.resize(numEdges);
+  double* ratios = edgeRatios.data();
+
+  //every edge is measured once, each edge owns its own slot so this can run on any thread
+  //the rest length is cached as its reciprocal
+  stressParallelFor(numEdges, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    kernel(points, edgeFrom, edgeTo, invRest, ratios, begin, end);
+  });
+}
+
+void StressKernel::finalize(const StressTopology& topology, const StressSettings& settings, double* values, StressStats* stats){
+  finalizeRatios(topology, settings, edgeRatios.data(), values, stats);
+}
+
+template<typename Ratio>
+void StressKernel::finalizeRatios(const StressTopology& topology, const StressSettings& settings, const Ratio* ratios,
+                                  double* values, StressStats* stats){
+  const unsigned int numVertices = topology.numVertices();
+  const unsigned int* offsets = topology.offsets.data();
+  const unsigned int* neighborEdges = topology.neighborEdges.data();
+
+  //every vertex gathers the ratios of its edges, neighborEdges is sorted by edge index
+  //so the sum always runs in the same order whatever the thread count
+  if(!stats){
+    stressParallelFor(numVertices, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+      for(unsigned int v=begin; v<end; v++){
+        values[v] = finalizeVertex(v, offsets, neighborEdges, ratios, settings);
+      } //end of v loop
+    });
+    return;
+  }
+
+  //same loop with every chunk reducing its own stats while the value is still in a register
+  const double range = settings.histogramRange > 0.0 ? settings.histogramRange : 1.0;
+  const double bucketScale = kStressHistogramBuckets / (2.0 * range);
+  const unsigned int grainSize = settings.grainSize > 0 ? settings.grainSize : 1;
+  const unsigned int numChunks = numVertices / grainSize + (numVertices % grainSize != 0 ? 1 : 0);
+  partials.resize(numChunks);
+
+  stressParallelFor(numVertices, grainSize, settings.numThreads, [&](unsigned int chunk, unsigned int begin, unsigned int end){
+    StressStats& partial = partials[chunk];
+    resetStats(partial);
+    for(unsigned int v=begin; v<end; v++){
+      const double value = finalizeVertex(v, offsets, neighborEdges, ratios, settings);
+      values[v] = value;
+      accumulateStats(partial, value, range, bucketScale);
+    } //end of v loop
+  });
+
+  mergeStats(numChunks, numVertices, *stats);
+}
+
+StressTemporal::StressTemporal() : mode(kStressTemporalOff), window(0), count(0), numFrames(0), next(0){ }
+
+namespace{
+  //the value of larger magnitude, a on ties so the older frame keeps the peak
+  inline double peakOf(double a, double b){
+    return std::fabs(b) > std::fabs(a) ? b : a;
+  }
+}
+
+void StressTemporal::accumulate(StressTemporalMode newMode, unsigned int newWindow, double smoothing, bool fold, double* values,
+                                unsigned int newCount, const StressSettings& settings){
+  if(newWindow == 0) newWindow = 1;
+  if(newMode != mode || newCount != count || (newMode == kStressTemporalWindow && newWindow != window)){
+    mode = newMode;
+    window = newWindow;
+    count = newCount;
+    reset();
+  }
+  if(mode == kStressTemporalOff || count == 0) return;
+
+  //the buffers are allocated once per mode, window and count, frames then only write into them
+  held.resize(count);
+  if(mode == kStressTemporalWindow) ring.resize(static_cast<size_t>(window) * count);
+
+  //nothing to hold yet, the frame is folded in either way
+  fold = fold || numFrames == 0;
+  const bool first = numFrames == 0;
+  const bool full = numFrames >= window;
+  const double alpha = std::min(1.0, std::max(0.0, smoothing));
+  const unsigned int slot = next;
+
+  stressParallelFor(count, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+    double* hold = held.data();
+    if(!fold){
+      std::copy(hold + begin, hold + end, values + begin);
+    }
+    else if(mode == kStressTemporalAverage){
+      for(unsigned int v=begin; v<end; v++){
+        hold[v] = first ? values[v] : hold[v] + alpha * (values[v] - hold[v]);
+        values[v] = hold[v];
+      }
+    }
+    else if(mode == kStressTemporalPeak){
+      for(unsigned int v=begin; v<end; v++){
+        hold[v] = first ? values[v] : peakOf(hold[v], values[v]);
+        values[v] = hold[v];
+      }
+    }
+    else{
+      //every vertex keeps its window in one row next to each other and the peak of the row in held,
+      //the row is only scanned again when the frame leaving the window was that peak
+      //on ties the newest frame is the peak, so it leaves the window as late as possible
+      for(unsigned int v=begin; v<end; v++){
+        double* row = ring.data() + static_cast<size_t>(v) * window;
+        const double expired = row[slot];
+        row[slot] = values[v];
+        if(full && expired == hold[v]){
+          //newest to oldest, slot back to 0 and then the end of the row back to slot + 1
+          double peak = row[slot];
+          for(unsigned int s=slot; s>0; s--){
+            peak = peakOf(peak, row[s - 1]);
+          }
+          for(unsigned int s=window-1; s>slot; s--){
+            peak = peakOf(peak, row[s]);
+          }
+          hold[v] = peak;
+        }
+        else{
+          hold[v] = first || std::fabs(values[v]) >= std::fabs(hold[v]) ? values[v] : hold[v];
+        }
+        values[v] = hold[v];
+      }
+    }
+  });
+
+  if(fold){
+    numFrames++;
+    next = (next + 1) % window;
+  }
+}
@@ -0,0 +1,301 @@
+//stressCore.h
+//maya independent part of the stress map: topology, rest lengths and the stress kernel
+
+#ifndef stressCore_H
+#define stressCore_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "stressSimd.h"
+
+//flat (CSR) adjacency of the reference mesh plus its unique edge list
+//the neighbors of vertex v are neighbors[offsets[v]] .. neighbors[offsets[v+1] - 1]
+struct StressTopology{
+  std::vector<unsigned int> offsets;  //one entry per vertex plus a closing one
+  std::vector<unsigned int> neighbors;  //two entries per edge, one for each end
+  std::vector<unsigned int> neighborEdges;  //unique edge index of every neighbors entry
+  std::vector<unsigned int> edgeFrom;  //first end of every unique edge
+  std::vector<unsigned int> edgeTo;  //second end of every unique edge
+
+  unsigned int numVertices() const { return offsets.empty() ? 0 : static_cast<unsigned int>(offsets.size() - 1); };
+  unsigned int numEdges() const { return static_cast<unsigned int>(edgeFrom.size()); };
+  bool empty() const { return offsets.empty(); };
+  void clear();
+};
+
+//triangles of the reference mesh with their rest shape, for the area and strain metrics
+//the triangles of vertex v are vertexTriangles[offsets[v]] .. vertexTriangles[offsets[v+1] - 1]
+struct StressTriangles{
+  std::vector<unsigned int> vertices;  //three per triangle
+  std::vector<double> restInverse;  //upper triangular inverse of the rest edge matrix in the triangle's own plane
+                                    //(m00, m01, m11), three per triangle, all 0 when degenerated
+  std::vector<unsigned int> offsets;  //one entry per vertex plus a closing one
+  std::vector<unsigned int> vertexTriangles;  //sorted triangle ids of every vertex
+
+  unsigned int numTriangles() const { return static_cast<unsigned int>(vertices.size() / 3); };
+  bool empty() const { return offsets.empty(); };
+  void clear();
+};
+
+//region of interest, the vertices a mask keeps and the edges they need
+struct StressMask{
+  std::vector<unsigned int> vertices;  //active vertices, sorted
+  std::vector<unsigned int> edges;  //every edge with at least one active end, sorted
+  std::vector<unsigned int> edgeFrom;  //end points of edges, packed so the edge kernels can stream them
+  std::vector<unsigned int> edgeTo;
+  std::vector<unsigned int> lines;  //two indices into vertices per edge with both ends active, for drawing
+  std::vector<unsigned int> support;  //every end point of edges, the only positions the mask reads
+
+  bool empty() const { return vertices.empty(); };
+  void clear();
+};
+
+//spatial clusters of the reference vertices, for culling and level of detail when drawing
+//vertices are grouped along a morton curve of their rest positions so every cluster stays compact
+//the vertices of cluster c are vertices[offsets[c]] .. vertices[offsets[c+1] - 1], its edges likewise in edges
+struct StressClusters{
+  std::vector<unsigned int> offsets;  //one entry per cluster plus a closing one
+  std::vector<unsigned int> vertices;  //vertex ids sorted by cluster
+  std::vector<unsigned int> representatives;  //vertex closest to the rest centroid of every cluster
+  std::vector<unsigned int> edgeOffsets;  //one entry per cluster plus a closing one
+  std::vector<unsigned int> edges;  //unique edges sorted by the cluster of their first end
+  std::vector<unsigned int> coarseFrom;  //pairs of clusters sharing at least one edge, drawn between their representatives
+  std::vector<unsigned int> coarseTo;
+
+  unsigned int numClusters() const { return offsets.empty() ? 0 : static_cast<unsigned int>(offsets.size() - 1); };
+  bool empty() const { return offsets.empty(); };
+  void clear();
+};
+
+//what gets drawn of a cluster
+enum StressClusterState{
+  kStressClusterCulled = 0,  //outside the view
+  kStressClusterCoarse,  //only its representative
+  kStressClusterFull  //every vertex and edge
+};
+
+//what the per vertex values measure
+enum StressMetric{
+  kStressEdgeLength = 0,  //average edge length ratio
+  kStressArea,  //average triangle area ratio
+  kStressMajorStrain,  //average largest principal stretch of the triangles
+  kStressMinorStrain  //average smallest principal stretch of the triangles
+};
+
+//user settings of the stress evaluation
+struct StressSettings{
+  double multiplier = 1.0;
+  double clampMax = 1.0;
+  bool normalize = false;
+  unsigned int numThreads = 0;  //0 uses every core
+  unsigned int grainSize = 4096;  //items per task, fewer than this runs serially
+  double histogramRange = 1.0;  //the histogram covers [-histogramRange, histogramRange]
+  unsigned int smoothIterations = 0;  //laplacian passes over the values, see StressKernel::smooth
+  double smoothStrength = 0.5;  //how far every pass moves a value towards its neighbors' average
+};
+
+//buckets of the stress histogram, the first and last one also count everything past the range
+const unsigned int kStressHistogramBuckets = 32;
+
+//statistics of one evaluation, gathered in the same pass as the values
+struct StressStats{
+  double minimum = 0.0;
+  double maximum = 0.0;
+  double mean = 0.0;
+  unsigned int count = 0;
+  unsigned int histogram[kStressHistogramBuckets] = {};
+
+  //factor that maps the values into [-1, 1] by their largest magnitude, 1 when every value is 0
+  double autoScale() const;
+};
+
+//build the adjacency from the unique edges, edgeVertices holds two vertex ids per edge
+//edge order is kept, so neighborEdges of every vertex end up sorted
+void stressBuildTopology(StressTopology& topology, unsigned int numVertices, const unsigned int* edgeVertices, unsigned int numEdges);
+
+//identity of a polygon mesh's topology, meshes with the same fingerprint share a connection tree
+struct StressFingerprint{
+  unsigned int numVertices = 0;
+  unsigned int numFaces = 0;
+  unsigned int numFaceVertices = 0;
+  uint64_t hash = 0;  //hash of the face sizes and face vertex ids
+
+  bool operator==(const StressFingerprint& other) const{
+    return numVertices == other.numVertices && numFaces == other.numFaces && numFaceVertices == other.numFaceVertices && hash == other.hash;
+  };
+  bool operator!=(const StressFingerprint& other) const { return !(*this == other); };
+};
+StressFingerprint stressFingerprint(unsigned int numVertices, const unsigned int* faceCounts, unsigned int numFaces,
+                                    const unsigned int* faceConnects, unsigned int numFaceVertices);
+
+//hash of the exact float bits of interleaved xyz points, changes whenever a point moves
+uint64_t stressHashPoints(const float* xyz, unsigned int numVertices);
+
+//compact copy of a tree and its rest lengths, only the unique edges are stored and the adjacency is rebuilt on read
+//pointsHash identifies the reference positions the rest lengths were measured on
+void stressWriteTopology(const StressFingerprint& fingerprint, uint64_t pointsHash, const StressTopology& topology,
+                         const std::vector<double>& invRestLengths, std::vector<unsigned char>& bytes);
+//false when bytes aren't a complete, consistent copy, the outputs are then left alone
+bool stressReadTopology(const unsigned char* bytes, size_t size, StressFingerprint& fingerprint, uint64_t& pointsHash,
+                        StressTopology& topology, std::vector<double>& invRestLengths);
+
+//unique edges of a polygon mesh given as face sizes and face vertex ids, in first seen order
+void stressEdgesFromFaces(unsigned int numVertices, const std::vector<unsigned int>& faceCounts,
+                          const std::vector<unsigned int>& faceConnects, std::vector<unsigned int>& edgeVertices);
+
+//1 / rest length of every unique edge, degenerated edges get 0
+void stressBuildRestLengths(const StressTopology& topology, const StressPositions& reference, std::vector<double>& invRestLengths);
+
+//ear clipping triangulation of a polygon mesh in the pose of points, three vertex ids per triangle
+//the node and the standalone tools share it so n-gons are split the same way everywhere
+void stressTriangulateFaces(const std::vector<unsigned int>& faceCounts, const std::vector<unsigned int>& faceConnects,
+                            const StressPositions& points, std::vector<unsigned int>& triangleVertices);
+
+//adjacency and rest matrices of the triangles, reference holds the rest pose
+void stressBuildTriangles(StressTriangles& triangles, unsigned int numVertices, const unsigned int* triangleVertices,
+                          unsigned int numTriangles, const StressPositions& reference);
+
+//mask of the vertices whose flag in active (numVertices entries) is not 0
+void stressBuildMask(StressMask& mask, const StressTopology& topology, const unsigned char* active);
+
+//clusters of at most clusterSize vertices, xyz holds the interleaved rest positions
+void stressBuildClusters(StressClusters& clusters, const StressTopology& topology, const float* xyz, unsigned int clusterSize);
+
+//bounds of every cluster in the pose xyz (interleaved), six floats per cluster: minimum then maximum xyz
+void stressClusterBounds(const StressClusters& clusters, const float* xyz, const StressSettings& settings, std::vector<float>& bounds);
+
+//one StressClusterState per cluster of bounds, viewProjection is a row vector 4x4 (maya's MMatrix layout)
+//and width, height the viewport in pixels, clusters smaller than lodPixels on screen are coarse, 0 keeps them full
+void stressClassifyClusters(const std::vector<float>& bounds, const double* viewProjection, double width, double height,
+                            bool cull, double lodPixels, unsigned char* states);
+
+//line indices (two vertex ids per line) of what states keeps: the edges of full clusters and,
+//for every pair of neighboring clusters with a coarse one and none culled, a line between their representatives
+void stressClusterLines(const StressClusters& clusters, const StressTopology& topology, const unsigned char* states,
+                        std::vector<unsigned int>& lines);
+//vertex ids of what states keeps: every vertex of the full clusters and the representatives of the coarse ones
+void stressClusterPoints(const StressClusters& clusters, const unsigned char* states, std::vector<unsigned int>& points);
+
+//what the temporal accumulation keeps of the per frame values
+enum StressTemporalMode{
+  kStressTemporalOff = 0,
+  kStressTemporalAverage,  //exponential moving average
+  kStressTemporalPeak,  //largest magnitude since the last reset, with its sign
+  kStressTemporalWindow  //largest magnitude over the last window frames, with its sign
+};
+
+//the stress kernel, keeps its scratch memory between evaluations
+class StressKernel{
+  public:
+    StressKernel();
+
+    void setSimdLevel(StressSimdLevel level);
+    StressSimdLevel simdLevel() const { return level; };
+
+    //full evaluation, values needs room for topology.numVertices() entries
+    //stats, when given, are reduced in the same pass
+    void compute(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                 const StressPositions& points, const StressSettings& settings, double* values, StressStats* stats = nullptr);
+
+    //same in single precision, the edges are measured in floats and averaged in doubles
+    //invRestLengths is the float copy of the double rest lengths
+    void computeFloat(const StressTopology& topology, const std::vector<float>& invRestLengths,
+                      const StressFloatPositions& points, const StressSettings& settings, double* values, StressStats* stats = nullptr);
+
+    //re-evaluates only the vertices that moved more than epsilon since the last evaluation and
+    //their one ring, values must still hold the previous results
+    //returns how many vertices were recomputed, stats are left alone when that is 0
+    //and need a sweep over values when only part of the mesh was recomputed
+    unsigned int computeIncremental(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                                    const StressPositions& points, const StressSettings& settings, double epsilon,
+                                    double* values, StressStats* stats = nullptr);
+
+    //edge metric of the mask's vertices only, measuring just the edges they need
+    //values outside the mask are left alone, stats describe the masked vertices
+    void computeMasked(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                       const StressPositions& points, const StressSettings& settings, const StressMask& mask,
+                       double* values, StressStats* stats = nullptr);
+
+    //area ratio and both principal stretches from the deformation gradient of every triangle in one pass,
+    //then averaged to the vertices and remapped like the edge ratios, any output can be null
+    //stats, when given, describe the output picked by statsMetric
+    void computeTriangleMetrics(const StressTriangles& triangles, const StressPositions& points, const StressSettings& settings,
+                                double* area, double* majorStrain, double* minorStrain,
+                                StressMetric statsMetric = kStressArea, StressStats* stats = nullptr);
+
+    //settings.smoothIterations jacobi passes of value += smoothStrength * (average of the neighbors - value)
+    //over the tree's adjacency, ping ponging between values and a scratch buffer the kernel keeps
+    //stats, when given, describe the smoothed values
+    void smooth(const StressTopology& topology, const StressSettings& settings, double* values, StressStats* stats = nullptr);
+
+    //stats of values that didn't come out of a full pass
+    void computeStats(const double* values, unsigned int count, const StressSettings& settings, StressStats& stats);
+
+    //forget the cached positions, the next incremental call evaluates everything
+    void invalidate() { cacheValid = false; };
+
+    //the two phases of compute, exposed for profiling
+    void computeEdgeRatios(const StressTopology& topology, const std::vector<double>& invRestLengths,
+                           const StressPositions& points, const StressSettings& settings);
+    void finalize(const StressTopology& topology, const StressSettings& settings, double* values, StressStats* stats = nullptr);
+
+    const std::vector<double>& ratios() const { return edgeRatios; };
+
+  private:
+    StressSimdLevel level;
+    StressEdgeRatioKernel edgeKernel;
+    StressEdgeRatioFloatKernel edgeFloatKernel;
+    StressDetectKernel detectKernel;
+    std::vector<double> edgeRatios;  //current / rest length of every unique edge
+    std::vector<StressStats> partials;  //per chunk stats, mean holds the sum until they are merged
+    std::vector<double> triangleMetrics;  //area ratio, major and minor stretch of every triangle, three per triangle
+    std::vector<double> maskRestLengths;  //invRestLengths of the mask's edges, packed like the mask
+    std::vector<double> maskRatios;  //ratios of the mask's edges before they are scattered into edgeRatios
+    std::vector<float> edgeFloatRatios;  //edgeRatios of the single precision path
+    std::vector<double> smoothed;  //the other buffer of the smoothing passes
+
+    template<typename Ratio>
+    void finalizeRatios(const StressTopology& topology, const StressSettings& settings, const Ratio* ratios,
+                        double* values, StressStats* stats);
+
+    void mergeStats(unsigned int numChunks, unsigned int count, StressStats& stats) const;
+
+    //incremental evaluation state
+    bool cacheValid;
+    StressPositions previous;  //positions the cached results were computed from
+    StressSettings previousSettings;
+    std::vector<unsigned char> moved;  //per vertex flag of the last change detection
+    std::vector<unsigned int> edgeStamp;  //edge already recomputed when equal to stamp
+    std::vector<unsigned int> vertexStamp;  //vertex already queued when equal to stamp
+    std::vector<unsigned int> touched;  //vertices to finalize
+    unsigned int stamp;
+};
+
+//per vertex accumulation of the values over frames, the memory is kept between frames and resets
+class StressTemporal{
+  public:
+    StressTemporal();
+
+    //folds one frame of values into the accumulation when fold is set and writes the accumulated values over them,
+    //without fold values are only replaced by what was accumulated so far
+    //a new mode, window or count starts over, smoothing is the weight of the new frame in the average
+    void accumulate(StressTemporalMode mode, unsigned int window, double smoothing, bool fold, double* values,
+                    unsigned int count, const StressSettings& settings);
+
+    //the next frame starts a new accumulation
+    void reset() { numFrames = 0; next = 0; };
+    unsigned int frames() const { return numFrames; };
+
+  private:
+    StressTemporalMode mode;
+    unsigned int window;
+    unsigned int count;
+    unsigned int numFrames;  //frames folded in since the last reset
+    unsigned int next;  //ring slot the next frame goes into
+    std::vector<double> held;  //average or peak of every vertex
+    std::vector<double> ring;  //the last window values of every vertex, vertex after vertex
+};
+
+#endif
@@ -4,23 +4,44 @@
 #  include <GLUT/glut.h>  // deginitions for the GLUT utility toolkit
 
 #include "stressMap.h"
+#include "stressParallel.h"
+#include "stressTopologyData.h"
 
+#include <maya/MArrayDataBuilder.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MFn.h>
+#include <maya/MFnComponentListData.h>
 #include <maya/MFnCompoundAttribute.h>
 #include <maya/MFnDoubleArrayData.h>
 #include <maya/MFnEnumAttribute.h>
+#include <maya/MFnIntArrayData.h>
 #include <maya/MFnMatrixAttribute.h>
 #include <maya/MFnMesh.h>
+#include <maya/MFnMeshData.h>
 #include <maya/MFnNumericAttribute.h>  //numeric attribute function set
+#include <maya/MFnPluginData.h>
+#include <maya/MFnSingleIndexedComponent.h>
+#include <maya/MFnStringData.h>
 #include <maya/MFnTypedAttribute.h>  //static class provviding common API global functions
+#include <maya/MFnUnitAttribute.h>
+#include <maya/MEvaluationNode.h>
 #include <maya/MGlobal.h>  //static class provviding common API global functions
 #include <maya/MIntArray.h>
-#include <maya/MItMeshPolygon.h>
-#include <maya/MItMeshVertex.h>
+#include <maya/MMatrix.h>
 #include <maya/MPlug.h>
 #include <maya/MPointArray.h>
+#include <maya/MProfiler.h>
+#include <maya/MProfilingScope.h>
+#include <maya/MStringArray.h>
+#include <maya/MTime.h>
 #include <maya/MVector.h>
 #include <maya/MViewport2Renderer.h>
 
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
 MTypeId StressMap::typeId(0x9011E000);  //define value for typeId
 
 //node drawdb classification string
@@ -37,15 +58,108 @@ MObject StressMap::normalize;
 MObject StressMap::squashColor;
 MObject StressMap::stretchColor;
 MObject StressMap::intensity;
+MObject StressMap::numThreads;
+MObject StressMap::grainSize;
+MObject StressMap::incremental;
+MObject StressMap::changeEpsilon;
+MObject StressMap::recomputedVertices;
+MObject StressMap::outputAllocations;
+MObject StressMap::time;
+MObject StressMap::cacheFile;
+MObject StressMap::playback;
+MObject StressMap::autoNormalize;
+MObject StressMap::stressMin;
+MObject StressMap::stressMax;
+MObject StressMap::stressMean;
+MObject StressMap::stressHistogram;
+MObject StressMap::metric;
+MObject StressMap::areaRatio;
+MObject StressMap::majorStrain;
+MObject StressMap::minorStrain;
+MObject StressMap::batch;
+MObject StressMap::batchInput;
+MObject StressMap::batchReference;
+MObject StressMap::batchOutput;
+MObject StressMap::recordTimings;
+MObject StressMap::topologyTime;
+MObject StressMap::readPointsTime;
+MObject StressMap::outputTime;
+MObject StressMap::stressTime;
+MObject StressMap::batchTime;
+MObject StressMap::totalTime;
+MObject StressMap::processedVertices;
+MObject StressMap::topologyHits;
+MObject StressMap::topologyMisses;
+MObject StressMap::topologyCache;
+MObject StressMap::maskComponents;
+MObject StressMap::maskWeights;
+MObject StressMap::precision;
+MObject StressMap::quantizeColors;
+MObject StressMap::outMesh;
+MObject StressMap::colorSetName;
+MObject StressMap::frustumCulling;
+MObject StressMap::lodPixels;
+MObject StressMap::clusterSize;
+MObject StressMap::temporalMode;
+MObject StressMap::temporalWindow;
+MObject StressMap::temporalSmoothing;
+MObject StressMap::temporalReset;
+MObject StressMap::smoothIterations;
+MObject StressMap::smoothStrength;
+int StressMap::profilerCategory = -1;
+
+StressMap::StressMap() : topology(std::make_shared<StressTopology>()), result(std::make_shared<StressResult>()), evaluationCount(0), outputAllocationCount(0), topologyVersion(0), batchTopologyVersion(0), referenceDirty(true), cacheDirty(true), trianglesDirty(true), batchReferenceDirty(true), processedCount(0), topologyHitCount(0), topologyMissCount(0), mask(std::make_shared<StressMask>()), masked(false), maskDirty(true), maskTopologyVersion(0), maskVersion(0), outMeshTopologyVersion(0), clusters(std::make_shared<StressClusters>()), clustersDirty(true), clusterSizeBuilt(0), clusterVersion(0), temporalTime(0.0), temporalTopologyVersion(0), glPositionBuffer(0), glColorBuffer(0), glIndexBuffer(0), glIndexCount(0), glVertexCount(0), glTopologyVersion(0), glEvaluation(0), glClusterVersion(0), timingsEnabled(false){ }
+
+//buffers of deleted nodes, there may be no view or the wrong context current when a node goes away,
+//so they wait for the next legacy draw to release them while its context is current
+static std::mutex orphanedBuffersLock;
+static std::vector<GLuint> orphanedBuffers;
+
+StressMap::~StressMap(){
+  if(glIndexBuffer){
+    std::lock_guard<std::mutex> guard(orphanedBuffersLock);
+    orphanedBuffers.insert(orphanedBuffers.end(), {glPositionBuffer, glColorBuffer, glIndexBuffer});
+  }
+}
+
+MBoundingBox StressMap::boundingBox() const{
+  //no evaluation is triggered from here, the draw's own fakeOut pull brings the result up to date
+  return lastResult()->bounds;
+}
+
+std::shared_ptr<const StressResult> StressMap::lastResult() const{
+  return std::atomic_load(&result);
+}
+
+void StressMap::closeCache(){
+  cache.close();
+  cacheDirty = true;
+}
+
+//array output that keeps its data object while the length fits, returns the storage to write into
+static double* arrayOutput(MDataBlock& dataBlock, const MObject& attribute, unsigned int length){
+  MDataHandle handle = dataBlock.outputValue(attribute);
+  MFnDoubleArrayData dataFn;
+  const MObject data = handle.data();
+  if(data.isNull() || (dataFn.setObject(data) != MS::kSuccess) || (dataFn.length() != length)){
+    handle.setMObject(dataFn.create(MDoubleArray(length, 0.0)));
+    dataFn.setObject(handle.data());
+  }
+  handle.setClean();
 
-StressMap::StressMap() : firstRun(0){ }
+  MDoubleArray values = dataFn.array();
+  return length != 0 ? &values[0] : nullptr;
+}
 
 MStatus StressMap::initialize(){
+  profilerCategory = MProfiler::addCategory("stressMap", "stressMap node evaluation and drawing");
+
   MFnEnumAttribute enumFn;
   MFnMatrixAttribute matrixFn;
   MFnNumericAttribute numFn;
   MFnCompoundAttribute compA;
   MFnTypedAttribute typedFn;
+  MFnUnitAttribute unitFn;
 
   inputMesh = typedFn.create("inputMesh", "inm", MFnData::kMesh);
   addAttribute(inputMesh);
@@ -76,6 +190,55 @@ MStatus StressMap::initialize(){
   numFn.setStorable(true);
   addAttribute(normalize);
 
+  //what the output measures, the triangle metrics also fill areaRatio, majorStrain and minorStrain
+  metric = enumFn.create("metric", "met", kStressEdgeLength);
+  enumFn.addField("Edge Length", kStressEdgeLength);
+  enumFn.addField("Area", kStressArea);
+  enumFn.addField("Major Strain", kStressMajorStrain);
+  enumFn.addField("Minor Strain", kStressMinorStrain);
+  enumFn.setKeyable(true);
+  enumFn.setStorable(true);
+  addAttribute(metric);
+
+  //region of interest, only the listed vertices and the ones painted above 0 are evaluated, the rest report 0
+  //with both empty the whole mesh is, the mask applies to the edge length metric of the single pair
+  maskComponents = typedFn.create("maskComponents", "mcp", MFnData::kComponentList);
+  typedFn.setStorable(true);
+  addAttribute(maskComponents);
+
+  maskWeights = typedFn.create("maskWeights", "mwt", MFnData::kDoubleArray);
+  typedFn.setStorable(true);
+  addAttribute(maskWeights);
+
+  //float runs the edge metric on the mesh's own float points, at half the memory traffic
+  //it replaces the incremental path, the mask, the triangle metrics and the batch stay in double
+  precision = enumFn.create("precision", "prc", kStressDouble);
+  enumFn.addField("Double", kStressDouble);
+  enumFn.addField("Float", kStressFloat);
+  enumFn.setStorable(true);
+  addAttribute(precision);
+
+  //laplacian passes over the values of the single pair and the batch, each moves a value smoothStrength of the way
+  //to its neighbors' average, a masked evaluation isn't smoothed
+  smoothIterations = numFn.create("smoothIterations", "smi", MFnNumericData::kInt, 0);
+  numFn.setMin(0);
+  numFn.setSoftMax(20);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(smoothIterations);
+
+  smoothStrength = numFn.create("smoothStrength", "sms", MFnNumericData::kDouble, 0.5);
+  numFn.setMin(0.0);
+  numFn.setMax(1.0);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(smoothStrength);
+
+  //the viewport colors the values through a table of 256 steps over their range instead of one by one
+  quantizeColors = numFn.create("quantizeColors", "qcl", MFnNumericData::kBoolean, 0);
+  numFn.setStorable(true);
+  addAttribute(quantizeColors);
+
   squashColor = numFn.createColor("squashColor", "sqc");
   numFn.setDefault(0.0f, 1.0f, 0.0f);
   numFn.setKeyable(true);
@@ -97,6 +260,183 @@ MStatus StressMap::initialize(){
   numFn.setKeyable(true);
   addAttribute(intensity);
 
+  //draw the values remapped to the frame's own range instead of clamped to [-1, 1]
+  //display only, output keeps the raw values and stressMin/stressMax give their range
+  autoNormalize = numFn.create("autoNormalize", "ano", MFnNumericData::kBoolean, 0);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(autoNormalize);
+
+  //0 uses every core
+  numThreads = numFn.create("numThreads", "nth", MFnNumericData::kInt, 0);
+  numFn.setStorable(true);
+  numFn.setMin(0);
+  addAttribute(numThreads);
+
+  //items per task, meshes smaller than this are evaluated serially
+  grainSize = numFn.create("grainSize", "gsz", MFnNumericData::kInt, 4096);
+  numFn.setStorable(true);
+  numFn.setMin(1);
+  addAttribute(grainSize);
+
+  //only recompute the vertices that moved since the last evaluation
+  incremental = numFn.create("incremental", "inc", MFnNumericData::kBoolean, 0);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(incremental);
+
+  changeEpsilon = numFn.create("changeEpsilon", "ceps", MFnNumericData::kDouble, 1e-6);
+  numFn.setStorable(true);
+  numFn.setMin(0);
+  addAttribute(changeEpsilon);
+
+  //stats, how many vertices the last evaluation actually computed
+  recomputedVertices = numFn.create("recomputedVertices", "rcv", MFnNumericData::kInt, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(recomputedVertices);
+
+  //stats, stays the same once the node warmed up as the output is written in place
+  outputAllocations = numFn.create("outputAllocations", "oal", MFnNumericData::kInt, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(outputAllocations);
+
+  //microseconds spent in every phase of the last compute, the clock is only read while this is on
+  recordTimings = numFn.create("recordTimings", "rtm", MFnNumericData::kBoolean, 0);
+  numFn.setStorable(true);
+  addAttribute(recordTimings);
+
+  topologyTime = numFn.create("topologyTime", "tpt", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(topologyTime);
+
+  readPointsTime = numFn.create("readPointsTime", "rpt", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(readPointsTime);
+
+  outputTime = numFn.create("outputTime", "opt", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(outputTime);
+
+  stressTime = numFn.create("stressTime", "sti", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(stressTime);
+
+  batchTime = numFn.create("batchTime", "bti", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(batchTime);
+
+  totalTime = numFn.create("totalTime", "tti", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(totalTime);
+
+  //vertices the last compute read, the single pair and the whole batch
+  processedVertices = numFn.create("processedVertices", "pcv", MFnNumericData::kInt, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(processedVertices);
+
+  //reference changes that kept the topology and so the connection tree, and the ones that rebuilt it
+  topologyHits = numFn.create("topologyHits", "tph", MFnNumericData::kInt, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(topologyHits);
+
+  topologyMisses = numFn.create("topologyMisses", "tpm", MFnNumericData::kInt, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(topologyMisses);
+
+  //connection tree and rest lengths of the last build, saved with the scene so file open doesn't rebuild them
+  topologyCache = typedFn.create("topologyCache", "tpc", StressTopologyData::id);
+  typedFn.setStorable(true);
+  typedFn.setHidden(true);
+  typedFn.setConnectable(false);
+  addAttribute(topologyCache);
+
+  //baked playback, written by the stressMapBake command
+  time = unitFn.create("time", "tim", MFnUnitAttribute::kTime, 0.0);
+  unitFn.setStorable(true);
+  addAttribute(time);
+
+  cacheFile = typedFn.create("cacheFile", "cf", MFnData::kString);
+  typedFn.setStorable(true);
+  typedFn.setUsedAsFilename(true);
+  addAttribute(cacheFile);
+
+  //serve the output from the cache at the current time instead of evaluating the meshes
+  playback = numFn.create("playback", "pb", MFnNumericData::kBoolean, 0);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(playback);
+
+  //stats of the last evaluation, reduced in the same pass as the values
+  stressMin = numFn.create("stressMin", "smn", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(stressMin);
+
+  stressMax = numFn.create("stressMax", "smx", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(stressMax);
+
+  stressMean = numFn.create("stressMean", "sme", MFnNumericData::kDouble, 0);
+  numFn.setStorable(false);
+  numFn.setWritable(false);
+  addAttribute(stressMean);
+
+  //every triangle metric comes out of the same pass, empty while the metric is Edge Length
+  areaRatio = typedFn.create("areaRatio", "arr", MFnData::kDoubleArray);
+  typedFn.setStorable(false);
+  typedFn.setWritable(false);
+  addAttribute(areaRatio);
+
+  majorStrain = typedFn.create("majorStrain", "mjs", MFnData::kDoubleArray);
+  typedFn.setStorable(false);
+  typedFn.setWritable(false);
+  addAttribute(majorStrain);
+
+  minorStrain = typedFn.create("minorStrain", "mns", MFnData::kDoubleArray);
+  typedFn.setStorable(false);
+  typedFn.setWritable(false);
+  addAttribute(minorStrain);
+
+  //fixed buckets over [-1, 1], the end buckets also count everything past it
+  stressHistogram = typedFn.create("stressHistogram", "shi", MFnData::kIntArray);
+  typedFn.setStorable(false);
+  typedFn.setWritable(false);
+  addAttribute(stressHistogram);
+
+  //more input / reference pairs evaluated by the same compute, one batchOutput element per pair
+  //with the same logical index, they use the edge length metric and the settings of the node
+  batchInput = typedFn.create("batchInput", "bin", MFnData::kMesh);
+  typedFn.setStorable(false);
+
+  batchReference = typedFn.create("batchReference", "brf", MFnData::kMesh);
+  typedFn.setStorable(true);
+
+  batch = compA.create("batch", "bat");
+  compA.addChild(batchInput);
+  compA.addChild(batchReference);
+  compA.setArray(true);
+  compA.setDisconnectBehavior(MFnAttribute::kDelete);
+  addAttribute(batch);
+
+  batchOutput = typedFn.create("batchOutput", "bout", MFnData::kDoubleArray);
+  typedFn.setArray(true);
+  typedFn.setUsesArrayDataBuilder(true);
+  typedFn.setWritable(false);
+  typedFn.setStorable(false);
+  addAttribute(batchOutput);
+
   //used to force maya to evaluate
   //connect to locator -> visibility
   fakeOut = numFn.create("fakeOut", "fo", MFnNumericData::kBoolean, 1);
@@ -104,6 +444,69 @@ MStatus StressMap::initialize(){
   numFn.setStorable(true);
   addAttribute(fakeOut);
 
+  //inputMesh passed through with the stress ramp as per vertex colors in colorSetName, for shaded display
+  //and playblasts, while it is connected the locator no longer draws the single pair
+  outMesh = typedFn.create("outMesh", "om", MFnData::kMesh);
+  typedFn.setWritable(false);
+  typedFn.setStorable(false);
+  addAttribute(outMesh);
+
+  MFnStringData stringFn;
+  colorSetName = typedFn.create("colorSetName", "csn", MFnData::kString, stringFn.create("stressMap"));
+  typedFn.setStorable(true);
+  addAttribute(colorSetName);
+
+  //clusters of the reference outside the view aren't drawn, the ones smaller than lodPixels on screen
+  //are drawn as lines between their representatives, 0 draws every edge
+  frustumCulling = numFn.create("frustumCulling", "fcl", MFnNumericData::kBoolean, 1);
+  numFn.setStorable(true);
+  addAttribute(frustumCulling);
+
+  lodPixels = numFn.create("lodPixels", "lod", MFnNumericData::kDouble, 4.0);
+  numFn.setMin(0.0);
+  numFn.setSoftMax(64.0);
+  numFn.setStorable(true);
+  addAttribute(lodPixels);
+
+  //vertices per cluster, smaller clusters cull tighter but cost more to test every draw
+  clusterSize = numFn.create("clusterSize", "csz", MFnNumericData::kInt, 256);
+  numFn.setMin(1);
+  numFn.setStorable(true);
+  addAttribute(clusterSize);
+
+  //the output accumulated over the frames played, every time value is folded in once,
+  //evaluating the same time again shows the accumulation as it stands, a bake stores the accumulated values
+  //needs time connected, without it the output is the current frame only
+  temporalMode = enumFn.create("temporalMode", "tmd", kStressTemporalOff);
+  enumFn.addField("Off", kStressTemporalOff);
+  enumFn.addField("Average", kStressTemporalAverage);
+  enumFn.addField("Peak", kStressTemporalPeak);
+  enumFn.addField("Window", kStressTemporalWindow);
+  enumFn.setKeyable(true);
+  enumFn.setStorable(true);
+  addAttribute(temporalMode);
+
+  //frames the window mode takes the peak over
+  temporalWindow = numFn.create("temporalWindow", "twn", MFnNumericData::kInt, 24);
+  numFn.setMin(1);
+  numFn.setSoftMax(240);
+  numFn.setStorable(true);
+  addAttribute(temporalWindow);
+
+  //weight of the newest frame in the average
+  temporalSmoothing = numFn.create("temporalSmoothing", "tsm", MFnNumericData::kDouble, 0.25);
+  numFn.setMin(0.0);
+  numFn.setMax(1.0);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(temporalSmoothing);
+
+  //while on every evaluation starts a new accumulation, key it on for the first frame of a range
+  temporalReset = numFn.create("temporalReset", "trs", MFnNumericData::kBoolean, 0);
+  numFn.setKeyable(true);
+  numFn.setStorable(true);
+  addAttribute(temporalReset);
+
   output = typedFn.create("output", "out", MFnData::kDoubleArray);
   typedFn.setKeyable(false);
   typedFn.setWritable(false);
@@ -118,6 +521,15 @@ MStatus StressMap::initialize(){
   attributeAffects(stretchColor, output);
   attributeAffects(intensity, output);
   attributeAffects(normalize, output);
+  attributeAffects(incremental, output);
+  attributeAffects(changeEpsilon, output);
+  attributeAffects(time, output);
+  attributeAffects(cacheFile, output);
+  attributeAffects(playback, output);
+  attributeAffects(metric, output);
+  attributeAffects(maskComponents, output);
+  attributeAffects(maskWeights, output);
+  attributeAffects(precision, output);
 
   attributeAffects(inputMesh, fakeOut);
   attributeAffects(referenceMesh, fakeOut);
@@ -127,21 +539,146 @@ MStatus StressMap::initialize(){
   attributeAffects(stretchColor, fakeOut);
   attributeAffects(intensity, fakeOut);
   attributeAffects(normalize, fakeOut); //video has output not fakeOut??
+  attributeAffects(incremental, fakeOut);
+  attributeAffects(changeEpsilon, fakeOut);
+  attributeAffects(time, fakeOut);
+  attributeAffects(cacheFile, fakeOut);
+  attributeAffects(playback, fakeOut);
+  attributeAffects(autoNormalize, fakeOut);  //display only, the override scales the colors
+  attributeAffects(metric, fakeOut);
+  attributeAffects(maskComponents, fakeOut);
+  attributeAffects(maskWeights, fakeOut);
+  attributeAffects(precision, fakeOut);
+  attributeAffects(quantizeColors, fakeOut);  //display only, the override builds the table
+  attributeAffects(clusterSize, fakeOut);
+
+  attributeAffects(inputMesh, recomputedVertices);
+  attributeAffects(referenceMesh, recomputedVertices);
+  attributeAffects(clampMax, recomputedVertices);
+  attributeAffects(multiplier, recomputedVertices);
+  attributeAffects(normalize, recomputedVertices);
+  attributeAffects(incremental, recomputedVertices);
+  attributeAffects(changeEpsilon, recomputedVertices);
+  attributeAffects(playback, recomputedVertices);
+  attributeAffects(metric, recomputedVertices);
+  attributeAffects(maskComponents, recomputedVertices);
+  attributeAffects(maskWeights, recomputedVertices);
+  attributeAffects(precision, recomputedVertices);
+
+  attributeAffects(inputMesh, outputAllocations);
+  attributeAffects(referenceMesh, outputAllocations);
+  attributeAffects(cacheFile, outputAllocations);
+  attributeAffects(playback, outputAllocations);
+
+  const MObject batchInputs[] = {batchInput, batchReference, clampMax, multiplier, normalize, incremental, changeEpsilon};
+  for(const MObject& input : batchInputs){
+    attributeAffects(input, batchOutput);
+  }
+  attributeAffects(batchInput, fakeOut);
+  attributeAffects(batchReference, fakeOut);
+  attributeAffects(batchInput, recomputedVertices);
+  attributeAffects(batchReference, recomputedVertices);
+
+  //the timings and counters follow every input that makes the node compute
+  const MObject timingInputs[] = {inputMesh, referenceMesh, clampMax, multiplier, normalize, incremental, changeEpsilon,
+                                  time, cacheFile, playback, metric, batchInput, batchReference, recordTimings,
+                                  maskComponents, maskWeights, precision};
+  const MObject timingOutputs[] = {topologyTime, readPointsTime, outputTime, stressTime, batchTime, totalTime, processedVertices,
+                                   topologyHits, topologyMisses};
+  for(const MObject& input : timingInputs){
+    for(const MObject& timingOutput : timingOutputs){
+      attributeAffects(input, timingOutput);
+    }
+  }
+
+  //the stats follow everything the values depend on
+  const MObject statsInputs[] = {inputMesh, referenceMesh, clampMax, multiplier, normalize, time, cacheFile, playback, metric,
+                                 maskComponents, maskWeights, precision};
+  for(const MObject& input : statsInputs){
+    attributeAffects(input, stressMin);
+    attributeAffects(input, stressMax);
+    attributeAffects(input, stressMean);
+    attributeAffects(input, stressHistogram);
+    attributeAffects(input, areaRatio);
+    attributeAffects(input, majorStrain);
+    attributeAffects(input, minorStrain);
+  }
+
+  //smoothing changes every value the node puts out
+  const MObject smoothInputs[] = {smoothIterations, smoothStrength};
+  const MObject smoothOutputs[] = {output, fakeOut, batchOutput, recomputedVertices, stressMin, stressMax, stressMean, stressHistogram,
+                                   outMesh, topologyTime, readPointsTime, outputTime, stressTime, batchTime, totalTime, processedVertices};
+  for(const MObject& input : smoothInputs){
+    for(const MObject& smoothOutput : smoothOutputs){
+      attributeAffects(input, smoothOutput);
+    }
+  }
+
+  //the temporal settings change what the output holds, not how a frame is evaluated
+  const MObject temporalInputs[] = {temporalMode, temporalWindow, temporalSmoothing, temporalReset};
+  const MObject temporalOutputs[] = {output, fakeOut, stressMin, stressMax, stressMean, stressHistogram, outMesh};
+  for(const MObject& input : temporalInputs){
+    for(const MObject& temporalOutput : temporalOutputs){
+      attributeAffects(input, temporalOutput);
+    }
+  }
+
+  //the color set follows the values and the ramp they are drawn with
+  const MObject outMeshInputs[] = {inputMesh, referenceMesh, clampMax, multiplier, normalize, incremental, changeEpsilon,
+                                   time, cacheFile, playback, metric, maskComponents, maskWeights, precision,
+                                   squashColor, stretchColor, intensity, autoNormalize, colorSetName};
+  for(const MObject& input : outMeshInputs){
+    attributeAffects(input, outMesh);
+  }
 
   //Attribute Editor
   MString stressTemplateNode(MString() + "global proc AEstressMapTemplate( string $nodeName)\n" +
     "{editorTemplate -beginScrollLayout;\n" +
     "editorTemplate -beginLayout \"Setting Attributes\" -collapse 0;\n" +
+    "editorTemplate -addControl \"metric\";\n" +
     "editorTemplate -addControl \"normalize\";\n" +
     "editorTemplate -addControl \"clampMax\";\n" +
     "editorTemplate -addControl \"multiplier\";\n" +
+    "editorTemplate -addControl \"smoothIterations\";\n" +
+    "editorTemplate -addControl \"smoothStrength\";\n" +
     "editorTemplate -endLayout;\n" +
 
     "editorTemplate -beginLayout \"Drawing Attributes\" -collapse 0;\n" +
     "editorTemplate -addControl \"drawIt\";\n" +
     "editorTemplate -addControl \"intensity\";\n" +
+    "editorTemplate -addControl \"autoNormalize\";\n" +
     "editorTemplate -addControl \"squashColor\";\n" +
     "editorTemplate -addControl \"stretchColor\";\n" +
+    "editorTemplate -addControl \"colorSetName\";\n" +
+    "editorTemplate -addControl \"frustumCulling\";\n" +
+    "editorTemplate -addControl \"lodPixels\";\n" +
+    "editorTemplate -endLayout;\n" +
+
+    "editorTemplate -beginLayout \"Performance Attributes\" -collapse 1;\n" +
+    "editorTemplate -addControl \"numThreads\";\n" +
+    "editorTemplate -addControl \"grainSize\";\n" +
+    "editorTemplate -addControl \"incremental\";\n" +
+    "editorTemplate -addControl \"changeEpsilon\";\n" +
+    "editorTemplate -addControl \"clusterSize\";\n" +
+    "editorTemplate -addControl \"recomputedVertices\";\n" +
+    "editorTemplate -addControl \"outputAllocations\";\n" +
+    "editorTemplate -addControl \"recordTimings\";\n" +
+    "editorTemplate -addControl \"totalTime\";\n" +
+    "editorTemplate -addControl \"processedVertices\";\n" +
+    "editorTemplate -addControl \"topologyHits\";\n" +
+    "editorTemplate -addControl \"topologyMisses\";\n" +
+    "editorTemplate -endLayout;\n" +
+
+    "editorTemplate -beginLayout \"Temporal Attributes\" -collapse 1;\n" +
+    "editorTemplate -addControl \"temporalMode\";\n" +
+    "editorTemplate -addControl \"temporalWindow\";\n" +
+    "editorTemplate -addControl \"temporalSmoothing\";\n" +
+    "editorTemplate -addControl \"temporalReset\";\n" +
+    "editorTemplate -endLayout;\n" +
+
+    "editorTemplate -beginLayout \"Cache Attributes\" -collapse 1;\n" +
+    "editorTemplate -addControl \"playback\";\n" +
+    "editorTemplate -addControl \"cacheFile\";\n" +
     "editorTemplate -endLayout;\n" +
 
     "editorTemplate -addExtraControls;\n" +
@@ -152,95 +689,580 @@ MStatus StressMap::initialize(){
   return MS::kSuccess;
 }
 
-MStatus StressMap::compute(const MPlug& plug, MDataBlock& dataBlock){
-  //trigger only when needed
-  MPlug inputMeshP(thisMObject(), inputMesh);
-  if(!inputMeshP.isConnected()){
-    return MS::kNotImplemented;
+MStatus StressMap::setDependentsDirty(const MPlug& plugBeingDirtied, MPlugArray& affectedPlugs){
+  //the reference mesh changed, the cached rest lengths are stale
+  if(plugBeingDirtied == referenceMesh){
+    referenceDirty = true;
+  }
+  //a new cache file has to be mapped again
+  if(plugBeingDirtied == cacheFile){
+    cacheDirty = true;
+  }
+  if(plugBeingDirtied == batchReference){
+    batchReferenceDirty = true;
+  }
+  if(plugBeingDirtied == maskComponents || plugBeingDirtied == maskWeights){
+    maskDirty = true;
   }
 
+  return MPxLocatorNode::setDependentsDirty(plugBeingDirtied, affectedPlugs);
+}
+
+MStatus StressMap::preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode){
+  //the evaluation manager does not go through setDependentsDirty every frame
+  if(context.isNormal() && evaluationNode.dirtyPlugExists(referenceMesh)){
+    referenceDirty = true;
+  }
+  if(context.isNormal() && evaluationNode.dirtyPlugExists(cacheFile)){
+    cacheDirty = true;
+  }
+  if(context.isNormal() && evaluationNode.dirtyPlugExists(batchReference)){
+    batchReferenceDirty = true;
+  }
+  if(context.isNormal() && (evaluationNode.dirtyPlugExists(maskComponents) || evaluationNode.dirtyPlugExists(maskWeights))){
+    maskDirty = true;
+  }
+
+  return MS::kSuccess;
+}
+
+MStatus StressMap::compute(const MPlug& plug, MDataBlock& dataBlock){
+  //trigger only when needed, either the single pair or the batch has to be connected
+  MPlug inputMeshP(thisMObject(), inputMesh);
   MPlug referenceMeshP(thisMObject(), referenceMesh);
-  if(!referenceMeshP.isConnected()){
+  const bool pairConnected = inputMeshP.isConnected() && referenceMeshP.isConnected();
+  if(!pairConnected && MPlug(thisMObject(), batch).numElements() == 0){
     return MS::kNotImplemented;
   }
 
   //gather data
+  StressSettings settings;
+  settings.multiplier = dataBlock.inputValue(multiplier).asDouble();
+  settings.clampMax = dataBlock.inputValue(clampMax).asDouble();
+  settings.normalize = dataBlock.inputValue(normalize).asBool();
+  settings.numThreads = static_cast<unsigned int>(dataBlock.inputValue(numThreads).asInt());
+  settings.grainSize = static_cast<unsigned int>(dataBlock.inputValue(grainSize).asInt());
+  settings.smoothIterations = static_cast<unsigned int>(std::max(0, dataBlock.inputValue(smoothIterations).asInt()));
+  settings.smoothStrength = dataBlock.inputValue(smoothStrength).asDouble();
+  const bool incrementalV = dataBlock.inputValue(incremental).asBool();
+  const double changeEpsilonV = dataBlock.inputValue(changeEpsilon).asDouble();
+  const bool outMeshWanted = plug == outMesh || MPlug(thisMObject(), outMesh).isConnected();
+  const unsigned int clusterSizeV = static_cast<unsigned int>(std::max(1, dataBlock.inputValue(clusterSize).asInt()));
+  startTimings(dataBlock.inputValue(recordTimings).asBool());
+
+  //compute fills the spare while the draw reads the published result, nothing the draw can reach is written.
+  //the spare was published before, a draw that loaded it then may still hold it, it is left to that draw.
+  //once unpublished nobody can take a new reference, so a count of 1 stays 1
+  if(!spare || spare.use_count() > 1){
+    spare = std::make_shared<StressResult>();
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);  //the last draw's reads happen before our writes
+  StressResult& current = *spare;
+  const StressResult& previous = *result;
+  StressPositions& inputPos = current.points;
+
+  //the batch is always evaluated live, the bake only covers the single pair
+  unsigned int recomputed = computeBatch(dataBlock, current, settings, incrementalV, changeEpsilonV);
+  timings.batch = lapTimings();
+  if(!pairConnected){
+    current.stress = nullptr;  //the single pair isn't evaluated, nothing of it is drawn
+    current.length = 0;
+    updateBounds(current, nullptr, 0, settings);
+    stampResult(current);
+    setStatsClean(dataBlock, current.stats, recomputed);
+    return MS::kSuccess;
+  }
+
+  //baked playback serves the output straight from the cache, neither mesh is evaluated
+  if(dataBlock.inputValue(playback).asBool()){
+    if(cacheDirty){
+      const MString cacheFileV = dataBlock.inputValue(cacheFile).asString();
+      std::string error;
+      if(cacheFileV.length() != 0 && !cache.open(cacheFileV.asChar(), error)){
+        MGlobal::displayError(MString("stressMap: ") + error.c_str());
+      }
+      cacheDirty = false;
+    }
+    if(cache.isOpen()){
+      const MStatus status = computeFromCache(dataBlock, current, settings, recomputed, clusterSizeV);
+      if(outMeshWanted){
+        MObject inputMeshV = dataBlock.inputValue(inputMesh).asMesh();
+        writeOutMesh(dataBlock, inputMeshV, current);
+      }
+      return status;
+    }
+  }
+
   MObject referenceMeshV = dataBlock.inputValue(referenceMesh).asMesh();
   MObject inputMeshV = dataBlock.inputValue(inputMesh).asMesh();
-  const double multiplierV = dataBlock.inputValue(multiplier).asDouble();
-  const double clampItMaxV = dataBlock.inputValue(clampMax).asDouble();
-  const bool normalizeV = dataBlock.inputValue(normalize).asBool();
-
-  //build tree if needed
-  if ((firstRun == 0) || (pointStoredTree.empty() == 1) || (stressMapValues.length() == 0)){
-    buildConnectionTree(pointStoredTree, stressMapValues, referenceMeshV);
+  const StressMetric metricV = static_cast<StressMetric>(dataBlock.inputValue(metric).asShort());
+
+  {
+    MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L1, "topology", "connection tree, rest lengths and triangles", thisMObject());
+
+    //a tree saved with the scene is used as long as the reference still has its topology
+    if(topology->empty() && loadTopologyCache(dataBlock, referenceMeshV)){
+      kernel.invalidate();
+      invRestLengthsFloat.clear();
+      clustersDirty = true;
+    }
+
+    //the tree is only rebuilt when the reference's topology really changed, moving its points keeps it
+    bool rebuilt = false;
+    if((referenceDirty && topologyChanged(fingerprint, referenceMeshV, topologyHitCount, topologyMissCount)) || topology->empty()){
+      topology = buildConnectionTree(referenceMeshV);
+      topologyVersion++;
+      kernel.invalidate();  //the cached values belong to the old tree
+      rebuilt = true;
+    }
+
+    //rest lengths only change with the reference mesh
+    if(referenceDirty || (invRestLengths.size() != topology->numEdges())){
+      buildRestLengths(*topology, invRestLengths, referenceMeshV);
+      trianglesDirty = true;  //their rest matrices come from the same reference
+      kernel.invalidate();
+      referenceDirty = false;
+      rebuilt = true;
+    }
+    if(rebuilt){
+      storeTopologyCache(dataBlock, referenceMeshV);
+      invRestLengthsFloat.clear();
+      clustersDirty = true;
+    }
+    buildClusters(referenceMeshV, clusterSizeV);
+
+    //the mask's indices belong to the tree it was built for
+    if(maskDirty || maskTopologyVersion != topologyVersion){
+      buildMask(dataBlock);
+    }
+
+    //the triangles share the reference's lifetime but are only built once a triangle metric asks for them
+    if(metricV != kStressEdgeLength && trianglesDirty){
+      buildTriangles(triangles, referenceMeshV);
+      trianglesDirty = false;
+    }
   }
+  timings.topology = lapTimings();
 
   //get input points
   MFnMesh inMeshFn(inputMeshV);
-  inMeshFn.getPoints(inputPos, MSpace::kObject);
+  const unsigned int intLength = inMeshFn.numVertices();
 
-  //get reference points
-  MFnMesh refMeshFn(referenceMeshV);
-  refMeshFn.getPoints(referencePos, MSpace::kObject);
-
-  const unsigned int intLength = inputPos.length();
-
-  //check input point size
-  if(intLength != referencePos.length()){
+  //check input point size, the face counts catch most meshes that got the same number of points another way
+  if(intLength != topology->numVertices()){
     MGlobal::displayError("Mismatching point number between input mesh and reference mesh");
     return MS::kSuccess;
   }
-
-  //check if size of stored point is the same of the inPoints
-  if(pointStoredTree.size() != intLength){
-    MGlobal::displayError("Mismatching in the ref and main data try to rebuild");
+  if(!sameCounts(fingerprint, inMeshFn)){
+    MGlobal::displayError("Mismatching topology between input mesh and reference mesh");
     return MS::kSuccess;
   }
+  processedCount += intLength;
+
+  //area ratio and both principal strains come out of one pass over the triangles,
+  //the output gets a copy of the picked one
+  const bool maskedPass = masked && metricV == kStressEdgeLength;
+  const bool floatPass = !maskedPass && metricV == kStressEdgeLength &&
+                         dataBlock.inputValue(precision).asShort() == kStressFloat;
+  double* stressMapValues;
+  double* areaValues;
+  double* majorValues;
+  double* minorValues;
+  const unsigned int triangleLength = metricV != kStressEdgeLength ? intLength : 0;
+  {
+    MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L2, "output", "output data objects", thisMObject());
+    stressMapValues = outputStorage(dataBlock, current, intLength);
+    areaValues = arrayOutput(dataBlock, areaRatio, triangleLength);
+    majorValues = arrayOutput(dataBlock, majorStrain, triangleLength);
+    minorValues = arrayOutput(dataBlock, minorStrain, triangleLength);
+  }
+  timings.output = lapTimings();
+
+  //read the points straight from the mesh storage into the structure of arrays
+  {
+    MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L2, "readPoints", "input points into the structure of arrays", thisMObject());
+    MStatus status;
+    const float* rawPoints = inMeshFn.getRawPoints(&status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    updateBounds(current, rawPoints, intLength, settings);
+    inputPos.resize(floatPass ? 0 : intLength);
+    current.floatPoints.resize(floatPass ? intLength : 0);
+    if(floatPass){
+      stressParallelFor(intLength, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+        stressLoadPositions(rawPoints, current.floatPoints, begin, end);
+      });
+    }
+    else if(maskedPass){
+      stressGatherPositions(rawPoints, inputPos, mask->support.data(), static_cast<unsigned int>(mask->support.size()));
+    }
+    else{
+      stressParallelFor(intLength, settings.grainSize, settings.numThreads, [&](unsigned int, unsigned int begin, unsigned int end){
+        stressLoadPositions(rawPoints, inputPos, begin, end);
+      });
+    }
+  }
+  timings.readPoints = lapTimings();
+
+  {
+    MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L3, "stress", "stress kernels", thisMObject());
+    if(triangleLength != 0){
+      kernel.computeTriangleMetrics(triangles, inputPos, settings, areaValues, majorValues, minorValues, metricV, &current.stats);
+      const double* picked = metricV == kStressArea ? areaValues : (metricV == kStressMajorStrain ? majorValues : minorValues);
+      std::copy(picked, picked + intLength, stressMapValues);
+      kernel.invalidate();  //the output no longer holds the edge values the incremental path builds on
+      recomputed += intLength;
+    }
+    //only the mask's edges and vertices are evaluated, the rest of the output is zeroed once per mask and storage
+    else if(intLength != 0 && maskedPass){
+      if(current.maskedFor != maskVersion){
+        std::fill(stressMapValues, stressMapValues + intLength, 0.0);
+        current.maskedFor = maskVersion;
+      }
+      kernel.computeMasked(*topology, invRestLengths, inputPos, settings, *mask, stressMapValues, &current.stats);
+      recomputed += static_cast<unsigned int>(mask->vertices.size());
+    }
+
+    //single precision edges, the rest lengths are converted once per reference
+    else if(intLength != 0 && floatPass){
+      if(invRestLengthsFloat.size() != invRestLengths.size()){
+        invRestLengthsFloat.assign(invRestLengths.begin(), invRestLengths.end());
+      }
+      kernel.computeFloat(*topology, invRestLengthsFloat, current.floatPoints, settings, stressMapValues, &current.stats);
+      recomputed += intLength;
+    }
+
+    //edge ratios and per vertex values, see stressCore.cpp
+    //the incremental path builds on the published values, only they are copied into this result's storage
+    else if(intLength != 0 && incrementalV){
+      keepValues(kernel, previous.stress, previous.length, stressMapValues, intLength);
+      recomputed += kernel.computeIncremental(*topology, invRestLengths, inputPos, settings, changeEpsilonV, stressMapValues, &current.stats);
+    }
+    else if(intLength != 0){
+      kernel.compute(*topology, invRestLengths, inputPos, settings, stressMapValues, &current.stats);
+      recomputed += intLength;
+    }
+
+    //a masked output only holds values inside its mask, it isn't smoothed
+    if(intLength != 0 && settings.smoothIterations != 0 && !maskedPass){
+      MProfilingScope smoothScope(profilerCategory, MProfiler::kColorE_L3, "smooth", "laplacian passes over the values", thisMObject());
+      kernel.smooth(*topology, settings, stressMapValues, &current.stats);
+      kernel.invalidate();  //the output no longer holds the values the incremental path builds on
+    }
+  }
+  timings.stress = lapTimings();
+  if(!maskedPass) current.maskedFor = 0;
+  applyTemporal(dataBlock, current, settings);
+  if(outMeshWanted){
+    MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L2, "outMesh", "stress colors into the output mesh", thisMObject());
+    writeOutMesh(dataBlock, inputMeshV, current);
+  }
+
+  stampResult(current);
+  setStatsClean(dataBlock, current.stats, recomputed);
 
-  double value = 0;
-  MVector storedLen, currentLen;
+  return MS::kSuccess;
+}
 
-  //loop every vertex to calculate stress data
-  for(int v=0; v<intLength; v++){
-    value = 0;
+void StressMap::startTimings(bool enabled){
+  timings = StressTimings();
+  processedCount = 0;
+  timingsEnabled = enabled;
+  if(enabled){
+    timingsStart = std::chrono::steady_clock::now();
+    timingsLap = timingsStart;
+  }
+}
 
-    //lets loop all the connected vtxs of the current vertex
-    for(int n=0; n<pointStoredTree[v].size; n++){
-      int connIndex = pointStoredTree[v].neighbors[n];  //alias for the neighbors for better readability
+double StressMap::lapTimings(){
+  if(!timingsEnabled) return 0.0;
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  const double elapsed = std::chrono::duration<double, std::micro>(now - timingsLap).count();
+  timingsLap = now;
+  return elapsed;
+}
 
-      //get vector length
-      storedLen = MVector(referencePos[connIndex] - referencePos[v]);
-      currentLen = MVector(inputPos[connIndex] - inputPos[v]);
+double* StressMap::outputStorage(MDataBlock& dataBlock, StressResult& current, unsigned int length){
+  //every result allocates its data object once, afterwards the plug is handed the one being filled
+  //and the values are written straight into its storage
+  MDataHandle outHandle = dataBlock.outputValue(output);
+  MFnDoubleArrayData outDataFn;
+  if(current.data.isNull() || (outDataFn.setObject(current.data) != MS::kSuccess) || (outDataFn.length() != length)){
+    current.data = outDataFn.create(MDoubleArray(length, 0.0));
+    outputAllocationCount++;
+  }
+  outHandle.setMObject(current.data);
+  current.data = outHandle.data();  //write into the object the plug actually serves
+  outDataFn.setObject(current.data);
+  MDoubleArray outValues = outDataFn.array();  //references the data object's storage, no copy
+  double* values = length != 0 ? &outValues[0] : nullptr;
+  if(values != current.stress){
+    current.maskedFor = 0;  //new storage, nothing in it was zeroed
+  }
+  current.stress = values;
+  current.length = length;
+  return values;
+}
 
-      //accumulate
-      value += (currentLen.length() / storedLen.length());
-    } //end of n loop
+void StressMap::keepValues(StressKernel& meshKernel, const double* previous, unsigned int previousLength, double* values, unsigned int length){
+  //the values of the last evaluation are what the kernel's cached positions belong to
+  if(!previous || previousLength != length){
+    meshKernel.invalidate();
+    return;
+  }
+  if(previous != values) std::copy(previous, previous + length, values);
+}
 
-    //average the full value by the number of edges
-    value = value / static_cast<double>(pointStoredTree[v].size);
+MStatus StressMap::computeFromCache(MDataBlock& dataBlock, StressResult& current, const StressSettings& settings,
+                                    unsigned int recomputed, unsigned int clusterSize){
+  //the edges to draw and their clusters still come from the reference, it is only read when there is no tree yet
+  if(topology->empty() || clustersDirty || clusterSize != clusterSizeBuilt){
+    MObject referenceMeshV = dataBlock.inputValue(referenceMesh).asMesh();
+    if(topology->empty()){
+      if(!loadTopologyCache(dataBlock, referenceMeshV)){
+        topologyChanged(fingerprint, referenceMeshV, topologyHitCount, topologyMissCount);
+        topology = buildConnectionTree(referenceMeshV);
+        topologyVersion++;
+      }
+      clustersDirty = true;
+    }
+    buildClusters(referenceMeshV, clusterSize);
+  }
+  if(cache.vertexCount() != topology->numVertices()){
+    MGlobal::displayError("Mismatching point number between the stress cache and reference mesh");
+    return MS::kSuccess;
+  }
 
-    value -= 1;  //remap the value from 0 to 2 range to -1 to 1 range
-    value *= multiplierV;  //multiply value by the multiplier
+  const MTime timeV = dataBlock.inputValue(time).asTime();
+  const int frame = static_cast<int>(std::floor(timeV.as(MTime::uiUnit()) + 0.5));
+  double* values = outputStorage(dataBlock, current, cache.vertexCount());
+  timings.output = lapTimings();
+  if(values){
+    MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L3, "readCache", "stress values from the baked cache", thisMObject());
+    //the bake wrote the output as evaluated, it already went through the temporal accumulation
+    cache.readFrame(frame, values);
+    kernel.computeStats(values, cache.vertexCount(), settings, current.stats);
+  }
+  timings.stress = lapTimings();
+  processedCount += cache.vertexCount();
+
+  kernel.invalidate();  //the output no longer holds what the kernel computed
+  current.maskedFor = 0;
+  arrayOutput(dataBlock, areaRatio, 0);
+  arrayOutput(dataBlock, majorStrain, 0);
+  arrayOutput(dataBlock, minorStrain, 0);
+  current.points.resize(0);  //no input points were read, the override takes them from the input mesh
+  current.floatPoints.resize(0);
+
+  //the bake stored the bounds of its clusters with every frame, the input mesh isn't read for them.
+  //they cull the node's clusters when they were baked for the same ones, either way they bound the pair
+  updateBounds(current, nullptr, 0, settings);
+  current.clusterBounds.resize(6 * static_cast<size_t>(cache.clusterCount()));
+  cache.readClusterBounds(frame, current.clusterBounds.data());
+  for(unsigned int c=0; c<cache.clusterCount(); c++){
+    const float* box = &current.clusterBounds[6 * c];
+    current.bounds.expand(MPoint(box[0], box[1], box[2]));
+    current.bounds.expand(MPoint(box[3], box[4], box[5]));
+  }
+  if(cache.clusterSize() != clusterSize || cache.clusterCount() != clusters->numClusters()){
+    current.clusterBounds.clear();
+  }
+  stampResult(current);
+  setStatsClean(dataBlock, current.stats, recomputed);
 
-    if (normalizeV == 1 && value > clampItMaxV) value = clampItMaxV;  //clamp the value
+  return MS::kSuccess;
+}
 
-    stressMapValues[v] = value;
+unsigned int StressMap::computeBatch(MDataBlock& dataBlock, StressResult& current, const StressSettings& settings,
+                                     bool incremental, double changeEpsilon){
+  MArrayDataHandle batchHandle = dataBlock.inputArrayValue(batch);
+  const unsigned int numMeshes = batchHandle.elementCount();
+  if(numMeshes == 0 && batchMeshes.empty()) return 0;
+  MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L1, "batch", "every mesh of the batch", thisMObject());
+  const bool resized = batchMeshes.size() != numMeshes;
+  batchMeshes.resize(numMeshes);
+  current.batch.resize(numMeshes);
+
+  //trees and rest lengths are built on the main thread, maya's mesh functions aren't called from the workers
+  std::vector<const float*> rawPoints(numMeshes, nullptr);
+  for(unsigned int i=0; i<numMeshes; i++){
+    batchHandle.jumpToArrayElement(i);
+    StressBatchMesh& mesh = batchMeshes[i];
+    MDataHandle element = batchHandle.inputValue();
+    if(batchReferenceDirty || resized || mesh.logicalIndex != batchHandle.elementIndex()){
+      MObject referenceV = element.child(batchReference).asMesh();
+      if(referenceV.isNull()){
+        mesh.topology = std::make_shared<StressTopology>();
+        mesh.invRestLengths.clear();
+        mesh.fingerprint = StressFingerprint();
+        batchTopologyVersion++;  //the override draws the batch edges too
+      }
+      else{
+        if(topologyChanged(mesh.fingerprint, referenceV, mesh.topologyHits, mesh.topologyMisses) || mesh.topology->empty()){
+          mesh.topology = buildConnectionTree(referenceV);
+          batchTopologyVersion++;
+        }
+        buildRestLengths(*mesh.topology, mesh.invRestLengths, referenceV);
+      }
+      mesh.kernel.invalidate();
+      mesh.logicalIndex = batchHandle.elementIndex();
+    }
+
+    MObject inputV = element.child(batchInput).asMesh();
+    if(inputV.isNull() || mesh.topology->empty()) continue;
+    MFnMesh meshFn(inputV);
+    if(static_cast<unsigned int>(meshFn.numVertices()) != mesh.topology->numVertices() || !sameCounts(mesh.fingerprint, meshFn)){
+      MString message("Mismatching topology between the input and reference mesh of batch ");
+      message += mesh.logicalIndex;
+      MGlobal::displayError(message);
+      continue;
+    }
+    rawPoints[i] = meshFn.getRawPoints(nullptr);
+  }
+  batchReferenceDirty = false;
+
+  //one output element per batch element, every result keeps a data object per element while its length fits
+  MArrayDataHandle outHandle = dataBlock.outputArrayValue(batchOutput);
+  MArrayDataBuilder builder = outHandle.builder();
+  for(unsigned int k=0; k<outHandle.elementCount(); k++){
+    outHandle.jumpToArrayElement(k);
+    const unsigned int logicalIndex = outHandle.elementIndex();
+    const bool used = std::any_of(batchMeshes.begin(), batchMeshes.end(),
+                                  [&](const StressBatchMesh& mesh){ return mesh.logicalIndex == logicalIndex; });
+    if(!used) builder.removeElement(logicalIndex);
+  }
+  for(unsigned int i=0; i<numMeshes; i++){
+    const unsigned int length = rawPoints[i] ? batchMeshes[i].topology->numVertices() : 0;
+    MDataHandle handle = builder.addElement(batchMeshes[i].logicalIndex);
+    StressMeshResult& meshResult = current.batch[i];
+    MFnDoubleArrayData dataFn;
+    if(meshResult.data.isNull() || (dataFn.setObject(meshResult.data) != MS::kSuccess) || (dataFn.length() != length)){
+      meshResult.data = dataFn.create(MDoubleArray(length, 0.0));
+      outputAllocationCount++;
+    }
+    handle.setMObject(meshResult.data);
+  }
+  outHandle.set(builder);
+
+  //the storage pointers are only stable once the builder was handed back
+  const StressResult& previous = *result;
+  for(unsigned int i=0; i<numMeshes; i++){
+    StressMeshResult& meshResult = current.batch[i];
+    outHandle.jumpToElement(batchMeshes[i].logicalIndex);
+    meshResult.data = outHandle.outputValue().data();
+    MFnDoubleArrayData dataFn(meshResult.data);
+    MDoubleArray values = dataFn.array();
+    meshResult.stress = values.length() != 0 ? &values[0] : nullptr;
+    meshResult.length = values.length();
+    //like the single pair the incremental path builds on the published values of the mesh
+    if(incremental){
+      const StressMeshResult* last = i < previous.batch.size() ? &previous.batch[i] : nullptr;
+      keepValues(batchMeshes[i].kernel, last ? last->stress : nullptr, last ? last->length : 0, meshResult.stress, meshResult.length);
+    }
+  }
+  outHandle.setAllClean();
+
+  //a mesh bigger than its share of the threads is split over all of them on its own,
+  //the rest are scheduled whole, largest first, each thread picking the next mesh once it is free
+  const unsigned int threads = settings.numThreads == 0 ? stressHardwareThreads() : settings.numThreads;
+  unsigned int totalLength = 0;
+  std::vector<unsigned int> order;
+  order.reserve(numMeshes);
+  for(unsigned int i=0; i<numMeshes; i++){
+    if(current.batch[i].length == 0) continue;
+    totalLength += current.batch[i].length;
+    order.push_back(i);
   }
+  std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+    return current.batch[a].length > current.batch[b].length;
+  });
+
+  processedCount += totalLength;
+
+  std::atomic<unsigned int> recomputed(0);
+  auto evaluate = [&](unsigned int i, const StressSettings& meshSettings){
+    StressMeshResult& meshResult = current.batch[i];
+    StressBatchMesh& mesh = batchMeshes[i];
+    meshResult.points.resize(meshResult.length);
+    stressLoadPositions(rawPoints[i], meshResult.points, 0, meshResult.length);
+    if(incremental){
+      recomputed += mesh.kernel.computeIncremental(*mesh.topology, mesh.invRestLengths, meshResult.points, meshSettings,
+                                                   changeEpsilon, meshResult.stress, &meshResult.stats);
+    }
+    else{
+      mesh.kernel.compute(*mesh.topology, mesh.invRestLengths, meshResult.points, meshSettings, meshResult.stress, &meshResult.stats);
+      recomputed += meshResult.length;
+    }
+    if(meshSettings.smoothIterations != 0){
+      mesh.kernel.smooth(*mesh.topology, meshSettings, meshResult.stress, &meshResult.stats);
+      mesh.kernel.invalidate();
+    }
+  };
+
+  size_t first = 0;
+  while(first < order.size() && threads > 1 && current.batch[order[first]].length * threads > totalLength){
+    evaluate(order[first++], settings);
+  }
+  StressSettings serial = settings;
+  serial.numThreads = 1;
+  stressParallelFor(static_cast<unsigned int>(order.size() - first), 1, threads, [&](unsigned int chunk, unsigned int, unsigned int){
+    evaluate(order[first + chunk], serial);
+  });
 
-  //set the output data
-  MFnDoubleArrayData outDataFn;
-  MObject outData = outDataFn.create(stressMapValues);
-  dataBlock.outputValue(output).setMObject(outData);
+  return recomputed;
+}
+
+void StressMap::setStatsClean(MDataBlock& dataBlock, const StressStats& stats, unsigned int recomputed){
+  //the output data already holds the values
   dataBlock.outputValue(output).setClean();
 
   dataBlock.outputValue(fakeOut).set(0);
   dataBlock.outputValue(fakeOut).setClean();
 
-  return MS::kSuccess;
+  dataBlock.outputValue(recomputedVertices).set(static_cast<int>(recomputed));
+  dataBlock.outputValue(recomputedVertices).setClean();
+
+  dataBlock.outputValue(outputAllocations).set(outputAllocationCount);
+  dataBlock.outputValue(outputAllocations).setClean();
+
+  dataBlock.outputValue(stressMin).set(stats.minimum);
+  dataBlock.outputValue(stressMin).setClean();
+  dataBlock.outputValue(stressMax).set(stats.maximum);
+  dataBlock.outputValue(stressMax).setClean();
+  dataBlock.outputValue(stressMean).set(stats.mean);
+  dataBlock.outputValue(stressMean).setClean();
+
+  const double totalTimeV = timingsEnabled ? std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - timingsStart).count() : 0.0;
+  const std::pair<MObject, double> timingOutputs[] = {{topologyTime, timings.topology}, {readPointsTime, timings.readPoints},
+                                                      {outputTime, timings.output}, {stressTime, timings.stress},
+                                                      {batchTime, timings.batch}, {totalTime, totalTimeV}};
+  for(const std::pair<MObject, double>& timing : timingOutputs){
+    dataBlock.outputValue(timing.first).set(timing.second);
+    dataBlock.outputValue(timing.first).setClean();
+  }
+  dataBlock.outputValue(processedVertices).set(static_cast<int>(processedCount));
+  dataBlock.outputValue(processedVertices).setClean();
+  dataBlock.outputValue(topologyHits).set(static_cast<int>(topologyHitCount));
+  dataBlock.outputValue(topologyHits).setClean();
+  dataBlock.outputValue(topologyMisses).set(static_cast<int>(topologyMissCount));
+  dataBlock.outputValue(topologyMisses).setClean();
+
+  //the histogram keeps its data object like the array outputs, the buckets are written in place
+  MDataHandle histogramHandle = dataBlock.outputValue(stressHistogram);
+  MFnIntArrayData histogramFn;
+  const MObject histogramData = histogramHandle.data();
+  if(histogramData.isNull() || (histogramFn.setObject(histogramData) != MS::kSuccess) || (histogramFn.length() != kStressHistogramBuckets)){
+    histogramHandle.setMObject(histogramFn.create(MIntArray(kStressHistogramBuckets, 0)));
+    histogramFn.setObject(histogramHandle.data());
+  }
+  MIntArray histogram = histogramFn.array();
+  for(unsigned int b=0; b<kStressHistogramBuckets; b++){
+    histogram[b] = static_cast<int>(stats.histogram[b]);
+  }
+  histogramHandle.setClean();
 }
 
-inline void stressLine(MPoint& p, float stress, const float* squashColor, const float* stretchColor, const float mult){
+//color of one end of a line, the squash side tops out a bit below full
+inline void stressLineColor(float stress, const float* squashColor, const float* stretchColor, const float mult, unsigned char* rgba){
   //check if the stress1 is greater than 0, if so this means its stretched
   const float* color = stress > 0 ? stretchColor : squashColor;
   //simply clamping the stretch in a range we like
@@ -251,9 +1273,11 @@ inline void stressLine(MPoint& p, float stress, const float* squashColor, const
   stress = stress < 0.0f ? -stress : stress;
   //alt way stress = std::fabs(stress); may sometimes be cast to double then float again
 
-  //setting the color and adding the vertex
-  glColor4f(color[0] * stress * mult, color[1] * stress * mult, color[2] * stress * mult, 1.0);
-  glVertex3d(p.x, p.y, p.z);
+  for(unsigned int c=0; c<3; c++){
+    const float channel = color[c] * stress * mult;
+    rgba[c] = static_cast<unsigned char>(channel <= 0.0f ? 0.0f : (channel >= 1.0f ? 255.0f : channel * 255.0f + 0.5f));
+  }
+  rgba[3] = 255;
 }
 
 void StressMap::draw(M3dView& view, const MDagPath& path, M3dView::DisplayStyle dispStyle, M3dView::DisplayStatus status){
@@ -261,7 +1285,8 @@ void StressMap::draw(M3dView& view, const MDagPath& path, M3dView::DisplayStyle
   bool drawItV;
   drawItP.getValue(drawItV);
 
-  if(drawItV == 0){
+  //the output mesh already shows the values in the shaded pipeline
+  if(drawItV == 0 || MPlug(thisMObject(), outMesh).isConnected()){
     return;
   }
 
@@ -279,29 +1304,12 @@ void StressMap::draw(M3dView& view, const MDagPath& path, M3dView::DisplayStyle
   inputMeshP.getValue(inputMeshV);
 
   MFnMesh meshFn(inputMeshV);
-  MPointArray inPoint;
-  meshFn.getPoints(inPoint);
-  MItMeshPolygon faceIt(inputMeshV);
-
-  //get colors
-  MPlug plug(thisMObject(), squashColor);
-  MObject object;
-  plug.getValue(object);
-  MFnNumericData fn(object);
-
-  float squashColorV[] = {0,0,0,1};
-  float stretchColorV[] = {0,0,0,1};
-  fn.getData(squashColorV[0], squashColorV[1], squashColorV[2]);
-
-  MPlug plug2(thisMObject(), stretchColor);
-  fn.setObject(plug2.asMObject());
-  fn.getData(stretchColorV[0], stretchColorV[1], stretchColorV[2]);
+  const unsigned int numVertices = inputMeshV.isNull() ? 0 : static_cast<unsigned int>(meshFn.numVertices());
+  const float* rawPoints = numVertices != 0 ? meshFn.getRawPoints(nullptr) : nullptr;
 
-  //color mult
-  MPlug intensityP(thisMObject(), intensity);
-  const float intensityVf = intensityP.asFloat();
-
-  if(stressMapValues.length() != inPoint.length()){
+  std::shared_ptr<const StressResult> last = lastResult();
+  const double* stressMapValues = last->stress;
+  if(!rawPoints || (last->length != numVertices) || (topology->numVertices() != numVertices)){
     return;
   }
 
@@ -310,88 +1318,463 @@ void StressMap::draw(M3dView& view, const MDagPath& path, M3dView::DisplayStyle
   ----------------------------------------------------------------*/
   view.beginGL();
   glPushAttrib(GL_ALL_ATTRIB_BITS);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glLineWidth(2);
-  if(status == M3dView::kLead)
-    glColor4f(0.0, 1.0, 0.0, 1.0f);
-  else
-    glColor4f(1.0, 1.0, 0.0, 1.0f);
-
-  faceIt.reset();
-
-  std::vector<int> edgesDone;
-  int size = meshFn.numEdges();
-  edgesDone.resize(size);
-
-  //this can be optimized with a memset to 0 -> goint to be much faster
-  for(int i=0; i<size; i++){
-    edgesDone[i] = 0;
-  }
-
-  MIntArray facePoint;
-  MIntArray edges;
-
-  //start the draw of the line
-  glBegin(GL_LINES);
-  for(; faceIt.isDone() != 1; faceIt.next()){
-    //draw the edges
-    //get vertexs
-    faceIt.getEdges(edges);
-    faceIt.getVertices(facePoint);
-
-    int len = edges.length();
-    for(int e=0; e<len; e++){
-      //check if edges were not done already
-      if(edgesDone[edges[e]] == 0){
-        //edges are in the same order of the points given back to us
-        //means that the first edge will have points index point[0] and point[1]
-
-        //here we check if we are not at the last edge we use point n and n+1
-        int vtx1 = facePoint[e];
-        int vtx2 = e != (len - 1) ? facePoint[e+1] : facePoint[0];
-
-        //draw the points
-        stressLine(inPoint[vtx1], stressMapValues[vtx1], squashColorV, stretchColorV, intensityVf);
-        stressLine(inPoint[vtx2], stressMapValues[vtx2], squashColorV, stretchColorV, intensityVf);
-
-        //mark the edge as drawn
-        edgesDone[edges[e]] = 1;
-      } //end of if edgesDone
-    } //end for e loop
-  } //end for faceIt
-  glEnd();
+
+  {
+    std::lock_guard<std::mutex> guard(orphanedBuffersLock);
+    if(!orphanedBuffers.empty()){
+      glDeleteBuffers(static_cast<GLsizei>(orphanedBuffers.size()), orphanedBuffers.data());
+      orphanedBuffers.clear();
+    }
+  }
+  if(!glIndexBuffer){
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+    glPositionBuffer = buffers[0];
+    glColorBuffer = buffers[1];
+    glIndexBuffer = buffers[2];
+  }
+
+  //clusters outside the view are skipped and small ones only drawn between their representatives,
+  //the states follow the camera but the index buffer only goes up again when one of them changes
+  std::vector<unsigned char> states;
+  const bool clustered = clusters->vertices.size() == numVertices && last->clusterVersion == clusterVersion &&
+                         last->clusterBounds.size() == 6 * static_cast<size_t>(clusters->numClusters());
+  if(clustered){
+    MMatrix modelView;
+    MMatrix projection;
+    view.modelViewMatrix(modelView);
+    view.projectionMatrix(projection);
+    const MMatrix viewProjection = modelView * projection;
+    states.resize(clusters->numClusters());
+    stressClassifyClusters(last->clusterBounds, viewProjection.matrix[0], view.portWidth(), view.portHeight(),
+                           MPlug(thisMObject(), frustumCulling).asBool(), MPlug(thisMObject(), lodPixels).asDouble(), states.data());
+  }
+
+  //without clusters the connection tree already holds every edge exactly once
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glIndexBuffer);
+  if(glTopologyVersion != topologyVersion || states != glClusterStates || (clustered && glClusterVersion != clusterVersion)){
+    std::vector<unsigned int> lineIndices;
+    if(clustered){
+      stressClusterLines(*clusters, *topology, states.data(), lineIndices);
+    }
+    else{
+      const unsigned int numEdges = topology->numEdges();
+      lineIndices.resize(static_cast<size_t>(numEdges) * 2);
+      for(unsigned int e=0; e<numEdges; e++){
+        lineIndices[2 * e] = topology->edgeFrom[e];
+        lineIndices[2 * e + 1] = topology->edgeTo[e];
+      }
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(lineIndices.size() * sizeof(unsigned int)), lineIndices.data(),
+                 clustered ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    glTopologyVersion = topologyVersion;
+    glClusterVersion = clusterVersion;
+    glClusterStates.swap(states);
+    glIndexCount = static_cast<unsigned int>(lineIndices.size());
+  }
+
+  //positions and colors only go up again after the node evaluated, redraws of the same frame reuse them
+  if(last->evaluation != glEvaluation || glVertexCount != numVertices){
+    //get colors
+    MPlug plug(thisMObject(), squashColor);
+    MObject object;
+    plug.getValue(object);
+    MFnNumericData fn(object);
+
+    float squashColorV[] = {0,0,0,1};
+    float stretchColorV[] = {0,0,0,1};
+    fn.getData(squashColorV[0], squashColorV[1], squashColorV[2]);
+
+    MPlug plug2(thisMObject(), stretchColor);
+    fn.setObject(plug2.asMObject());
+    fn.getData(stretchColorV[0], stretchColorV[1], stretchColorV[2]);
+
+    //color mult
+    MPlug intensityP(thisMObject(), intensity);
+    const float intensityVf = intensityP.asFloat();
+    const double scale = MPlug(thisMObject(), autoNormalize).asBool() ? last->stats.autoScale() : 1.0;
+
+    glColors.resize(static_cast<size_t>(numVertices) * 4);
+    for(unsigned int v=0; v<numVertices; v++){
+      stressLineColor(static_cast<float>(stressMapValues[v] * scale), squashColorV, stretchColorV, intensityVf, &glColors[4 * v]);
+    }
+
+    //the buffers are only reallocated when the point count changes
+    const GLsizeiptr positionBytes = static_cast<GLsizeiptr>(numVertices) * 3 * sizeof(float);
+    const GLsizeiptr colorBytes = static_cast<GLsizeiptr>(glColors.size());
+    glBindBuffer(GL_ARRAY_BUFFER, glPositionBuffer);
+    if(glVertexCount != numVertices) glBufferData(GL_ARRAY_BUFFER, positionBytes, rawPoints, GL_DYNAMIC_DRAW);
+    else glBufferSubData(GL_ARRAY_BUFFER, 0, positionBytes, rawPoints);
+    glBindBuffer(GL_ARRAY_BUFFER, glColorBuffer);
+    if(glVertexCount != numVertices) glBufferData(GL_ARRAY_BUFFER, colorBytes, glColors.data(), GL_DYNAMIC_DRAW);
+    else glBufferSubData(GL_ARRAY_BUFFER, 0, colorBytes, glColors.data());
+
+    glVertexCount = numVertices;
+    glEvaluation = last->evaluation;
+  }
+
+  //every edge in one call
+  glBindBuffer(GL_ARRAY_BUFFER, glPositionBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, nullptr);
+  glBindBuffer(GL_ARRAY_BUFFER, glColorBuffer);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glColorPointer(4, GL_UNSIGNED_BYTE, 0, nullptr);
+  if(glIndexCount != 0) glDrawElements(GL_LINES, static_cast<GLsizei>(glIndexCount), GL_UNSIGNED_INT, nullptr);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDisable(GL_BLEND);
+  glPopClientAttrib();
   glPopAttrib();
+  view.endGL();
 }
 
-void StressMap::buildConnectionTree(std::vector<StressPoint>& pointTree, MDoubleArray& stressMapValues, MObject& referenceMesh){
-  pointTree.clear();  //clear array and free the memory
-  stressMapValues.clear();  //clear the stress values
+StressFingerprint StressMap::referenceFingerprint(MObject& referenceMesh){
+  MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L1, "fingerprint", "hash of the reference's faces", thisMObject());
+
+  MFnMesh meshFn(referenceMesh);
+  MIntArray faceCounts;
+  MIntArray faceConnects;
+  meshFn.getVertices(faceCounts, faceConnects);
+
+  //MIntArray is contiguous, the ids are never negative
+  const unsigned int numFaces = faceCounts.length();
+  const unsigned int numFaceVertices = faceConnects.length();
+  return stressFingerprint(meshFn.numVertices(),
+                           numFaces != 0 ? reinterpret_cast<const unsigned int*>(&faceCounts[0]) : nullptr, numFaces,
+                           numFaceVertices != 0 ? reinterpret_cast<const unsigned int*>(&faceConnects[0]) : nullptr, numFaceVertices);
+}
+
+bool StressMap::topologyChanged(StressFingerprint& fingerprint, MObject& referenceMesh, unsigned int& hits, unsigned int& misses){
+  const StressFingerprint current = referenceFingerprint(referenceMesh);
+  if(current == fingerprint){
+    hits++;
+    return false;
+  }
+  fingerprint = current;
+  misses++;
+  return true;
+}
+
+void StressMap::writeOutMesh(MDataBlock& dataBlock, MObject& inputMeshV, const StressResult& current){
+  MDataHandle outHandle = dataBlock.outputValue(outMesh);
+  MFnMesh inMeshFn(inputMeshV);
+  const unsigned int numVertices = current.length;
+  if(inputMeshV.isNull() || !current.stress || static_cast<unsigned int>(inMeshFn.numVertices()) != numVertices){
+    outHandle.setClean();
+    return;
+  }
+
+  //same ramp as the locator
+  const float3& squashV = dataBlock.inputValue(squashColor).asFloat3();
+  const float3& stretchV = dataBlock.inputValue(stretchColor).asFloat3();
+  const MColor squash(squashV[0], squashV[1], squashV[2]);
+  const MColor stretch(stretchV[0], stretchV[1], stretchV[2]);
+  const float intensityV = static_cast<float>(dataBlock.inputValue(intensity).asDouble());
+  const double scale = dataBlock.inputValue(autoNormalize).asBool() ? current.stats.autoScale() : 1.0;
+  outMeshColors.setLength(numVertices);
+  for(unsigned int v=0; v<numVertices; v++){
+    outMeshColors[v] = stressColor(current.stress[v] * scale, squash, stretch, intensityV);
+  }
+
+  //the copy, the color set and its face vertex ids only change with the topology,
+  //every other evaluation moves the points and overwrites the color values in place
+  const MString colorSet = dataBlock.inputValue(colorSetName).asString();
+  MObject outData = outHandle.data();
+  MFnMesh outMeshFn;
+  const bool reuse = outMeshTopologyVersion == topologyVersion && colorSet == outMeshColorSet && !outData.isNull() &&
+                     outMeshFn.setObject(outData) == MS::kSuccess &&
+                     static_cast<unsigned int>(outMeshFn.numVertices()) == numVertices &&
+                     outMeshFn.numFaceVertices() == inMeshFn.numFaceVertices() &&
+                     outMeshColorIds.length() == static_cast<unsigned int>(inMeshFn.numFaceVertices());
+  if(reuse){
+    inMeshFn.getPoints(outMeshPoints);
+    outMeshFn.setPoints(outMeshPoints);
+    outMeshFn.setColors(outMeshColors, &colorSet);
+  }
+  else{
+    MFnMeshData dataFn;
+    outData = dataFn.create();
+    outMeshFn.copy(inputMeshV, outData);
+    outMeshFn.setObject(outData);
+
+    MIntArray faceCounts;
+    inMeshFn.getVertices(faceCounts, outMeshColorIds);
+    MStringArray colorSets;
+    outMeshFn.getColorSetNames(colorSets);
+    bool hasColorSet = false;
+    for(unsigned int i=0; i<colorSets.length(); i++){
+      hasColorSet = hasColorSet || colorSets[i] == colorSet;
+    }
+    if(!hasColorSet) outMeshFn.createColorSetWithName(colorSet);
+    outMeshFn.setCurrentColorSetName(colorSet);
+    outMeshFn.setColors(outMeshColors, &colorSet);
+    outMeshFn.assignColors(outMeshColorIds, &colorSet);
+    outMeshFn.setDisplayColors(true);
+    outHandle.set(outData);
+
+    outMeshTopologyVersion = topologyVersion;
+    outMeshColorSet = colorSet;
+  }
+  outHandle.setClean();
+}
+
+bool StressMap::applyTemporal(MDataBlock& dataBlock, StressResult& current, const StressSettings& settings){
+  const StressTemporalMode modeV = static_cast<StressTemporalMode>(dataBlock.inputValue(temporalMode).asShort());
+  if(dataBlock.inputValue(temporalReset).asBool() || temporalTopologyVersion != topologyVersion){
+    temporal.reset();
+    temporalTopologyVersion = topologyVersion;
+  }
+
+  //frames come from the time input, without a connection there is nothing to accumulate over
+  if(modeV == kStressTemporalOff || !current.stress || !MPlug(thisMObject(), time).isConnected()){
+    temporal.reset();
+    return false;
+  }
+
+  //only a new time is a new frame, evaluating the same time again shows what was accumulated up to it
+  const double timeV = dataBlock.inputValue(time).asTime().value();
+  const bool fold = temporal.frames() == 0 || timeV != temporalTime;
+  temporal.accumulate(modeV, static_cast<unsigned int>(std::max(1, dataBlock.inputValue(temporalWindow).asInt())),
+                      dataBlock.inputValue(temporalSmoothing).asDouble(), fold, current.stress, current.length, settings);
+  temporalTime = timeV;
+
+  kernel.invalidate();  //the output no longer holds the values the incremental path builds on
+  kernel.computeStats(current.stress, current.length, settings, current.stats);
+  return true;
+}
+
+void StressMap::buildMask(MDataBlock& dataBlock){
+  const unsigned int numVertices = topology->numVertices();
+  std::vector<unsigned char> active(numVertices, 0);
+  masked = false;
+
+  //vertex components, a complete component stands for every vertex
+  MObject componentsV = dataBlock.inputValue(maskComponents).data();
+  if(!componentsV.isNull()){
+    MFnComponentListData listFn(componentsV);
+    for(unsigned int c=0; c<listFn.length(); c++){
+      MObject component = listFn[c];
+      if(!component.hasFn(MFn::kMeshVertComponent)) continue;
+      MFnSingleIndexedComponent componentFn(component);
+      masked = true;
+      if(componentFn.isComplete()){
+        std::fill(active.begin(), active.end(), 1);
+        continue;
+      }
+      MIntArray ids;
+      componentFn.getElements(ids);
+      for(unsigned int i=0; i<ids.length(); i++){
+        if(ids[i] >= 0 && static_cast<unsigned int>(ids[i]) < numVertices) active[ids[i]] = 1;
+      }
+    }
+  }
+
+  //painted weights, one per vertex
+  MObject weightsV = dataBlock.inputValue(maskWeights).data();
+  if(!weightsV.isNull()){
+    MFnDoubleArrayData weightsFn(weightsV);
+    MDoubleArray weights = weightsFn.array();
+    const unsigned int numWeights = std::min(weights.length(), numVertices);
+    masked = masked || weights.length() != 0;
+    for(unsigned int v=0; v<numWeights; v++){
+      if(weights[v] > 0.0) active[v] = 1;
+    }
+  }
+
+  std::shared_ptr<StressMask> built = std::make_shared<StressMask>();
+  if(masked) stressBuildMask(*built, *topology, active.data());
+  mask = built;
+  maskDirty = false;
+  maskTopologyVersion = topologyVersion;
+  maskVersion++;
+}
+
+void StressMap::buildClusters(MObject& referenceMesh, unsigned int size){
+  if(!clustersDirty && size == clusterSizeBuilt) return;
+  MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L1, "buildClusters", "spatial clusters of the reference", thisMObject());
+
+  MFnMesh meshFn(referenceMesh);
+  const float* rawPoints = referenceMesh.isNull() ? nullptr : meshFn.getRawPoints(nullptr);
+  std::shared_ptr<StressClusters> built = std::make_shared<StressClusters>();
+  if(rawPoints && static_cast<unsigned int>(meshFn.numVertices()) == topology->numVertices()){
+    stressBuildClusters(*built, *topology, rawPoints, size);
+  }
+  clusters = built;
+  clustersDirty = false;
+  clusterSizeBuilt = size;
+  clusterVersion++;
+}
+
+void StressMap::stampResult(StressResult& current){
+  //the result keeps the trees it was evaluated with, the override reads them instead of the node's members
+  current.topology = topology;
+  current.topologyVersion = topologyVersion;
+  current.batchTopologyVersion = batchTopologyVersion;
+  current.mask = current.maskedFor != 0 && current.maskedFor == maskVersion && maskTopologyVersion == topologyVersion ? mask : nullptr;
+  current.maskVersion = maskVersion;
+  current.clusters = current.clusterVersion == clusterVersion ? clusters : nullptr;
+  for(size_t i=0; i<current.batch.size(); i++){
+    current.batch[i].topology = i < batchMeshes.size() ? batchMeshes[i].topology : nullptr;
+  }
+  current.evaluation = ++evaluationCount;
+
+  //the filled result becomes the one the draw reads, the one it replaces is filled next time
+  const std::shared_ptr<StressResult> filled = spare;
+  spare = std::atomic_exchange(&result, filled);
+}
+
+void StressMap::updateBounds(StressResult& current, const float* rawPoints, unsigned int numVertices, const StressSettings& settings){
+  current.bounds.clear();
+  for(const StressMeshResult& mesh : current.batch){
+    const StressPositions& points = mesh.points;
+    if(points.size() == 0) continue;
+    const auto x = std::minmax_element(points.x.begin(), points.x.end());
+    const auto y = std::minmax_element(points.y.begin(), points.y.end());
+    const auto z = std::minmax_element(points.z.begin(), points.z.end());
+    current.bounds.expand(MPoint(*x.first, *y.first, *z.first));
+    current.bounds.expand(MPoint(*x.second, *y.second, *z.second));
+  }
+
+  //the single pair's bounds are the union of its clusters' bounds, which the draws cull with
+  current.clusterVersion = clusterVersion;
+  if(rawPoints && clusters->vertices.size() == numVertices && numVertices != 0){
+    stressClusterBounds(*clusters, rawPoints, settings, current.clusterBounds);
+    for(unsigned int c=0; c<clusters->numClusters(); c++){
+      const float* box = &current.clusterBounds[6 * c];
+      current.bounds.expand(MPoint(box[0], box[1], box[2]));
+      current.bounds.expand(MPoint(box[3], box[4], box[5]));
+    }
+    return;
+  }
+  current.clusterBounds.clear();
+  for(unsigned int v=0; rawPoints && v<numVertices; v++){
+    current.bounds.expand(MPoint(rawPoints[3 * v], rawPoints[3 * v + 1], rawPoints[3 * v + 2]));
+  }
+}
+
+bool StressMap::loadTopologyCache(MDataBlock& dataBlock, MObject& referenceMesh){
+  const MObject data = dataBlock.inputValue(topologyCache).data();
+  if(data.isNull()) return false;
+  MFnPluginData dataFn(data);
+  const StressTopologyData* topologyData = dynamic_cast<const StressTopologyData*>(dataFn.constData());
+  if(!topologyData || topologyData->bytes.empty()) return false;
+
+  StressFingerprint cached;
+  uint64_t pointsHash = 0;
+  StressTopology loaded;
+  std::vector<double> loadedRestLengths;
+  if(!stressReadTopology(topologyData->bytes.data(), topologyData->bytes.size(), cached, pointsHash, loaded, loadedRestLengths)){
+    return false;
+  }
+
+  //a stale copy is ignored, the caller rebuilds the tree and stores a new one
+  const StressFingerprint current = referenceFingerprint(referenceMesh);
+  if(current != cached) return false;
+  topologyHitCount++;
+  fingerprint = current;
+  topology = std::make_shared<StressTopology>(std::move(loaded));
+  topologyVersion++;
+  trianglesDirty = true;
+
+  //the rest lengths are only kept when the reference points didn't move since they were measured
+  MFnMesh meshFn(referenceMesh);
+  const float* rawPoints = meshFn.getRawPoints(nullptr);
+  if(pointsHash != 0 && rawPoints && stressHashPoints(rawPoints, current.numVertices) == pointsHash){
+    invRestLengths = std::move(loadedRestLengths);
+    referenceDirty = false;
+  }
+  return true;
+}
+
+void StressMap::storeTopologyCache(MDataBlock& dataBlock, MObject& referenceMesh){
+  MFnMesh meshFn(referenceMesh);
+  const float* rawPoints = meshFn.getRawPoints(nullptr);
+  const uint64_t pointsHash = rawPoints ? stressHashPoints(rawPoints, topology->numVertices()) : 0;
+
+  MFnPluginData dataFn;
+  MObject data = dataFn.create(StressTopologyData::id);
+  StressTopologyData* topologyData = static_cast<StressTopologyData*>(dataFn.data());
+  stressWriteTopology(fingerprint, pointsHash, *topology, invRestLengths, topologyData->bytes);
+
+  //nothing depends on the attribute, writing it doesn't dirty anything
+  MDataHandle handle = dataBlock.outputValue(topologyCache);
+  handle.setMObject(data);
+  handle.setClean();
+}
+
+bool StressMap::sameCounts(const StressFingerprint& fingerprint, const MFnMesh& meshFn){
+  return static_cast<unsigned int>(meshFn.numVertices()) == fingerprint.numVertices &&
+         static_cast<unsigned int>(meshFn.numPolygons()) == fingerprint.numFaces &&
+         static_cast<unsigned int>(meshFn.numFaceVertices()) == fingerprint.numFaceVertices;
+}
+
+std::shared_ptr<const StressTopology> StressMap::buildConnectionTree(MObject& referenceMesh){
+  MProfilingScope profilingScope(profilerCategory, MProfiler::kColorE_L1, "buildConnectionTree", "unique edges of the reference mesh", thisMObject());
 
   //init mesh functions
-  MItMeshVertex iter(referenceMesh);
   MFnMesh meshFn(referenceMesh);
-  MPointArray points;
-  meshFn.getPoints(points);
+  const unsigned int numVertices = meshFn.numVertices();
+  const unsigned int numEdges = meshFn.numEdges();
+
+  //single walk over the edges to collect their end points
+  std::vector<unsigned int> edgeVertices(numEdges * 2);
+  int2 vtxs;
+  for(unsigned int e=0; e<numEdges; e++){
+    meshFn.getEdgeVertices(e, vtxs);
+    edgeVertices[2 * e] = vtxs[0];
+    edgeVertices[2 * e + 1] = vtxs[1];
+  }
 
-  int size = points.length();
-  //allocate memory for the arrays
-  pointTree.resize(size);
-  stressMapValues.setLength(size);
+  std::shared_ptr<StressTopology> topology = std::make_shared<StressTopology>();
+  stressBuildTopology(*topology, numVertices, edgeVertices.data(), numEdges);
+  return topology;
+}
 
-  //needed variables
-  int oldIndex;
+void StressMap::buildRestLengths(const StressTopology& topology, std::vector<double>& invRestLengths, MObject& referenceMesh){
+  MFnMesh meshFn(referenceMesh);
+  const unsigned int numVertices = meshFn.numVertices();
 
-  for(unsigned int i = 0; i<points.length(); i++){
-    StressPoint pnt;
+  StressPositions referencePos;
+  referencePos.resize(numVertices);
+  const float* rawPoints = meshFn.getRawPoints(nullptr);
+  if(rawPoints){
+    stressLoadPositions(rawPoints, referencePos, 0, numVertices);
+  }
 
-    iter.setIndex(i, oldIndex);
-    MIntArray vtxs;
-    iter.getConnectedVertices(vtxs);
-    pnt.neighbors = vtxs;
-    pnt.size = vtxs.length();
-    pointTree[i] = pnt;
-    stressMapValues[i] = 0;
+  stressBuildRestLengths(topology, referencePos, invRestLengths);
+}
+
+void StressMap::buildTriangles(StressTriangles& triangles, MObject& referenceMesh){
+  MFnMesh meshFn(referenceMesh);
+  const unsigned int numVertices = meshFn.numVertices();
+
+  StressPositions referencePos;
+  referencePos.resize(numVertices);
+  const float* rawPoints = meshFn.getRawPoints(nullptr);
+  if(rawPoints){
+    stressLoadPositions(rawPoints, referencePos, 0, numVertices);
   }
+
+  //the core's triangulation rather than maya's, so stressAnalyze splits n-gons the same way
+  MIntArray countsArray;
+  MIntArray connectsArray;
+  meshFn.getVertices(countsArray, connectsArray);
+  std::vector<unsigned int> faceCounts(countsArray.length());
+  std::vector<unsigned int> faceConnects(connectsArray.length());
+  for(unsigned int i=0; i<countsArray.length(); i++){
+    faceCounts[i] = static_cast<unsigned int>(countsArray[i]);
+  }
+  for(unsigned int i=0; i<connectsArray.length(); i++){
+    faceConnects[i] = static_cast<unsigned int>(connectsArray[i]);
+  }
+  std::vector<unsigned int> triangleVertices;
+  stressTriangulateFaces(faceCounts, faceConnects, referencePos, triangleVertices);
+
+  stressBuildTriangles(triangles, numVertices, triangleVertices.data(), static_cast<unsigned int>(triangleVertices.size() / 3), referencePos);
 }
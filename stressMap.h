@@ -4,29 +4,119 @@
 #define stressMap_H
 
 #include <maya/MTypeId.h>  //Manage Maya Object type identifiers
+#include <maya/MBoundingBox.h>
 #include <maya/MPxLocatorNode.h>  //Base class for user defined dependency nodes
 #include <maya/MPointArray.h>
 #include <maya/MDoubleArray.h>
+#include <maya/MColor.h>
+#include <maya/MColorArray.h>
+#include <maya/MFloatPointArray.h>
+#include <maya/MIntArray.h>
+#include <maya/MPlugArray.h>
+#include <chrono>
+#include <memory>
 #include <vector>
 
-//stores all data for a specific point
-struct StressPoint{
-  MIntArray neighbors; //know all the neighbors
-  MDoubleArray neighborsStress;  //know how much the edges changes
-  int size;
+#include "stressCache.h"
+#include "stressCore.h"
+
+class MFnMesh;
+
+//color of a stress value, squash for negative values and stretch for positive ones
+//faded by the amount of stress clamped to 1
+inline MColor stressColor(double stress, const MColor& squash, const MColor& stretch, float intensity){
+  const MColor& color = stress > 0.0 ? stretch : squash;
+  float amount = static_cast<float>(stress < 0.0 ? -stress : stress);
+  amount = (amount > 1.0f ? 1.0f : amount) * intensity;
+  return MColor(color.r * amount, color.g * amount, color.b * amount, 1.0f);
+}
+
+//precision the edge metric is evaluated in
+enum StressPrecision{
+  kStressDouble = 0,
+  kStressFloat  //edges measured on the mesh's own float points
+};
+
+//values of one mesh of the batch, same layout as the single pair in StressResult
+struct StressMeshResult{
+  MObject data;  //the batchOutput element's MFnDoubleArrayData, owned like the single pair's
+  double* stress = nullptr;
+  unsigned int length = 0;
+  StressPositions points;
+  StressStats stats;
+  std::shared_ptr<const StressTopology> topology;  //tree the values were evaluated with
+};
+
+//results of the last evaluation, shared with the draw override so it can read them without copies
+//the node fills one result while the draw reads the other, each owns its own storage
+struct StressResult{
+  MObject data;  //this result's MFnDoubleArrayData, the output plug is handed the one being filled
+  double* stress = nullptr;  //per vertex stress values, written in place inside data
+  unsigned int length = 0;
+  unsigned int maskedFor = 0;  //maskVersion the values outside the mask were zeroed for, 0 when they weren't
+  StressPositions points;  //input points the values were computed from
+  StressFloatPositions floatPoints;  //same for a single precision evaluation, points is then empty
+  StressStats stats;  //min, max, mean and histogram of stress
+  std::vector<float> clusterBounds;  //six floats per cluster of the node's clusters, in the drawn pose
+  unsigned int clusterVersion = 0;  //clusterVersion of the node the bounds were measured for
+  //the node's trees as of this evaluation, the node never changes them in place, a rebuild makes new ones
+  std::shared_ptr<const StressTopology> topology;
+  unsigned int topologyVersion = 0;
+  unsigned int batchTopologyVersion = 0;
+  std::shared_ptr<const StressMask> mask;  //only set when the output is masked with it
+  unsigned int maskVersion = 0;
+  std::shared_ptr<const StressClusters> clusters;
+  MBoundingBox bounds;  //every point the locator draws, the single pair and the batch
+  unsigned long long evaluation = 0;  //evaluation counter of the node when this was filled
+  std::vector<StressMeshResult> batch;  //one per element of the batch array, in element order
+};
+
+//microseconds spent in every phase of the last compute, only measured while recordTimings is on
+struct StressTimings{
+  double topology = 0.0;  //connection tree, rest lengths and triangles
+  double readPoints = 0.0;  //input points into the structure of arrays
+  double output = 0.0;  //output data objects
+  double stress = 0.0;  //the kernels, or decoding the cache in playback
+  double batch = 0.0;  //every mesh of the batch
+};
+
+//tree, rest lengths and kernel of one mesh of the batch
+struct StressBatchMesh{
+  std::shared_ptr<const StressTopology> topology = std::make_shared<StressTopology>();
+  std::vector<double> invRestLengths;
+  StressKernel kernel;
+  StressFingerprint fingerprint;  //of the reference the tree was built from
+  unsigned int logicalIndex = 0;  //batch element the state was built for
+  unsigned int topologyHits = 0;  //reference changes that kept the tree
+  unsigned int topologyMisses = 0;  //reference changes that rebuilt it
 };
 
 class StressMap final : public MPxLocatorNode{
   public:
     StressMap();
+    ~StressMap() override;
     static MStatus initialize();  //initialize node
     static void* creator() { return new StressMap(); };  //create node
     MStatus compute(const MPlug& plug, MDataBlock& data) override;  //implements core of the node
+    MStatus setDependentsDirty(const MPlug& plugBeingDirtied, MPlugArray& affectedPlugs) override;  //dirty tracking in DG mode
+    MStatus preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode) override;  //dirty tracking in parallel mode
 
     void draw(M3dView&, const MDagPath&, M3dView::DisplayStyle, M3dView::DisplayStatus) override;
-    bool isBounded() const override { return false; };
+    bool isBounded() const override { return true; };
+    MBoundingBox boundingBox() const override;
+
+    std::shared_ptr<const StressTopology> buildConnectionTree(MObject& referenceMesh);  //a new tree, results keep the old one
+    void stampResult(StressResult& current);  //stamps the filled result with the trees and publishes it to the draw
+    void buildRestLengths(const StressTopology& topology, std::vector<double>& invRestLengths, MObject& referenceMesh);
+    void buildTriangles(StressTriangles& triangles, MObject& referenceMesh);
 
-    void buildConnectionTree(std::vector<StressPoint>& pointTree, MDoubleArray& stressMapValues, MObject& referenceMesh);
+    //thread safe access to the last results for the draw override
+    std::shared_ptr<const StressResult> lastResult() const;
+
+    //unmap the baked cache, the bake command calls this before it rewrites the file
+    void closeCache();
+    //the next frame starts a new temporal accumulation, the bake starts and ends with it
+    void resetTemporal() { temporal.reset(); };
 
   public:
     //needed variables
@@ -35,10 +125,16 @@ class StressMap final : public MPxLocatorNode{
     static MObject drawIt;
     static MObject inputMesh;
     static MObject referenceMesh;
-    std::vector<StressPoint> pointStoredTree;
+    std::shared_ptr<const StressTopology> topology;  //replaced, not changed, on a rebuild so results can hold on to it
+    std::vector<double> invRestLengths;  //1 / rest length of every unique edge of the topology
+    std::vector<float> invRestLengthsFloat;  //float copy for the single precision path, empty until it is used
+    StressTriangles triangles;  //reference triangles and rest matrices for the area and strain metrics
 
     //
-    MDoubleArray stressMapValues;
+    std::shared_ptr<StressResult> result;  //published, the draw reads it through lastResult
+    std::shared_ptr<StressResult> spare;  //filled by compute, never handed out before it is published
+    unsigned long long evaluationCount;
+    int outputAllocationCount;  //times the output storage had to be allocated
     static const MString kDrawDbClassification;
     static MObject output;
     static MObject multiplier;
@@ -47,11 +143,132 @@ class StressMap final : public MPxLocatorNode{
     static MObject squashColor;
     static MObject stretchColor;
     static MObject intensity;
+    static MObject numThreads;
+    static MObject grainSize;
+    static MObject incremental;
+    static MObject changeEpsilon;
+    static MObject recomputedVertices;
+    static MObject outputAllocations;
+    static MObject time;
+    static MObject cacheFile;
+    static MObject playback;
+    static MObject autoNormalize;
+    static MObject stressMin;
+    static MObject stressMax;
+    static MObject stressMean;
+    static MObject stressHistogram;
+    static MObject metric;
+    static MObject areaRatio;
+    static MObject majorStrain;
+    static MObject minorStrain;
+    static MObject batch;
+    static MObject batchInput;
+    static MObject batchReference;
+    static MObject batchOutput;
+    static MObject recordTimings;
+    static MObject topologyTime;
+    static MObject readPointsTime;
+    static MObject outputTime;
+    static MObject stressTime;
+    static MObject batchTime;
+    static MObject totalTime;
+    static MObject processedVertices;
+    static MObject topologyHits;
+    static MObject topologyMisses;
+    static MObject topologyCache;
+    static MObject maskComponents;
+    static MObject maskWeights;
+    static MObject precision;
+    static MObject quantizeColors;
+    static MObject outMesh;
+    static MObject colorSetName;
+    static MObject frustumCulling;
+    static MObject lodPixels;
+    static MObject clusterSize;
+    static MObject temporalMode;
+    static MObject temporalWindow;
+    static MObject temporalSmoothing;
+    static MObject temporalReset;
+    static MObject smoothIterations;
+    static MObject smoothStrength;
+    static int profilerCategory;  //"stressMap" category of the evaluation manager profiler
+
+    unsigned int topologyVersion;  //bumped every time the single pair's connection tree is rebuilt
+    unsigned int batchTopologyVersion;  //bumped every time a batch mesh's tree is rebuilt or dropped
+    bool referenceDirty;  //rest lengths need to be rebuilt from the reference mesh
+    StressKernel kernel;  //maya independent stress kernel and its scratch memory
+    StressCacheReader cache;  //memory mapped bake, only used in playback mode
+    bool cacheDirty;  //cacheFile changed, the cache has to be mapped again
+    bool trianglesDirty;  //the triangles are only built once a triangle metric is used
+    std::vector<StressBatchMesh> batchMeshes;  //one per element of the batch array, in element order
+    bool batchReferenceDirty;  //a batch reference changed, every batch tree is rebuilt
+    StressTimings timings;
+    unsigned int processedCount;  //vertices the last compute read, single pair and batch
+    StressFingerprint fingerprint;  //of the reference the single pair's tree was built from
+    unsigned int topologyHitCount;  //reference changes that kept the tree
+    unsigned int topologyMissCount;  //reference changes that rebuilt it
+    std::shared_ptr<const StressMask> mask;  //region of interest of the single pair, only used while masked
+    bool masked;  //a mask input is set, the edge metric only evaluates the mask
+    bool maskDirty;  //a mask input changed
+    unsigned int maskTopologyVersion;  //topologyVersion the mask was built for
+    unsigned int maskVersion;  //bumped every time the mask is rebuilt
+    unsigned int outMeshTopologyVersion;  //topologyVersion outMesh was copied at, its color set is assigned then
+    MString outMeshColorSet;  //color set outMesh was built with
+    MIntArray outMeshColorIds;  //color of every face vertex, the vertex ids since colors are per vertex
+    MColorArray outMeshColors;  //one per vertex, refilled every evaluation
+    MFloatPointArray outMeshPoints;  //input points on their way into outMesh
+    std::shared_ptr<const StressClusters> clusters;  //spatial clusters of the reference for culling and level of detail
+    bool clustersDirty;  //the tree or the reference points changed since the clusters were built
+    unsigned int clusterSizeBuilt;  //clusterSize the clusters were built with
+    unsigned int clusterVersion;  //bumped every time the clusters are rebuilt
+    StressTemporal temporal;  //accumulation of the single pair's values over frames
+    double temporalTime;  //time of the last frame folded into temporal
+    unsigned int temporalTopologyVersion;  //topologyVersion temporal accumulates for
+
+    //legacy viewport buffer objects, 0 until the first draw, shared by every view through maya's shared context
+    unsigned int glPositionBuffer;  //input points as float xyz, straight from the mesh
+    unsigned int glColorBuffer;  //rgba8 per vertex
+    unsigned int glIndexBuffer;  //two vertices per edge of the tree
+    unsigned int glIndexCount;
+    unsigned int glVertexCount;  //vertices the position and color buffers were allocated for
+    unsigned int glTopologyVersion;  //topologyVersion the index buffer was built for
+    unsigned long long glEvaluation;  //evaluation the positions and colors were uploaded for
+    std::vector<unsigned char> glColors;  //upload staging of the colors
+    std::vector<unsigned char> glClusterStates;  //cluster states the index buffer was built for, empty when it holds every edge
+    unsigned int glClusterVersion;  //clusterVersion of glClusterStates
 
-    int firstRun;
-    MPointArray referencePos;
-    MPointArray inputPos;
+  private:
+    StressFingerprint referenceFingerprint(MObject& referenceMesh);
+    //fingerprints the reference, true and fingerprint updated when it differs from fingerprint, counted in hits or misses
+    bool topologyChanged(StressFingerprint& fingerprint, MObject& referenceMesh, unsigned int& hits, unsigned int& misses);
+    //single pair's tree and rest lengths from or into topologyCache, load is false when there is no valid copy
+    bool loadTopologyCache(MDataBlock& dataBlock, MObject& referenceMesh);
+    void storeTopologyCache(MDataBlock& dataBlock, MObject& referenceMesh);
+    //the mesh has the vertex, face and face vertex counts of fingerprint
+    static bool sameCounts(const StressFingerprint& fingerprint, const MFnMesh& meshFn);
+    void buildMask(MDataBlock& dataBlock);  //mask from maskComponents and maskWeights, against the current tree
+    void buildClusters(MObject& referenceMesh, unsigned int size);  //only when dirty or size changed
+    //bounds of the batch points plus rawPoints (numVertices interleaved xyz) of the single pair, nullptr when it isn't drawn
+    void updateBounds(StressResult& current, const float* rawPoints, unsigned int numVertices, const StressSettings& settings);
+    void startTimings(bool enabled);
+    double lapTimings();  //microseconds since the last lap, 0 when timings aren't recorded
+    double* outputStorage(MDataBlock& dataBlock, StressResult& current, unsigned int length);
+    //copies the published values into the storage being filled, or invalidates the kernel when they don't fit it
+    void keepValues(StressKernel& meshKernel, const double* previous, unsigned int previousLength, double* values, unsigned int length);
+    MStatus computeFromCache(MDataBlock& dataBlock, StressResult& current, const StressSettings& settings,
+                             unsigned int recomputed, unsigned int clusterSize);
+    unsigned int computeBatch(MDataBlock& dataBlock, StressResult& current, const StressSettings& settings,
+                              bool incremental, double changeEpsilon);
+    //inputMesh with the stress ramp in a color set, the copy and the color ids are only redone with the topology
+    void writeOutMesh(MDataBlock& dataBlock, MObject& inputMesh, const StressResult& current);
+    //folds the output into the temporal accumulation and leaves the accumulated values and their stats in it,
+    //false when temporalMode is off
+    bool applyTemporal(MDataBlock& dataBlock, StressResult& current, const StressSettings& settings);
+    void setStatsClean(MDataBlock& dataBlock, const StressStats& stats, unsigned int recomputed);
 
+    bool timingsEnabled;
+    std::chrono::steady_clock::time_point timingsStart;
+    std::chrono::steady_clock::time_point timingsLap;
 };
 
 #endif
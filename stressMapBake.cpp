@@ -0,0 +1,178 @@
+//stressMapBake.cpp
+#include "stressMapBake.h"
+#include "stressMap.h"
+
+#include <maya/MAnimControl.h>
+#include <maya/MArgDatabase.h>
+#include <maya/MDGContext.h>
+#include <maya/MDGContextGuard.h>
+#include <maya/MDGModifier.h>
+#include <maya/MDoubleArray.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnDoubleArrayData.h>
+#include <maya/MPlug.h>
+#include <maya/MSelectionList.h>
+#include <maya/MTime.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+static const char* kFileFlag = "-f";
+static const char* kFileFlagLong = "-file";
+static const char* kStartFlag = "-sf";
+static const char* kStartFlagLong = "-startFrame";
+static const char* kEndFlag = "-ef";
+static const char* kEndFlagLong = "-endFrame";
+static const char* kEncodingFlag = "-e";
+static const char* kEncodingFlagLong = "-encoding";
+
+MSyntax StressMapBake::newSyntax(){
+  MSyntax syntax;
+  syntax.addFlag(kFileFlag, kFileFlagLong, MSyntax::kString);
+  syntax.addFlag(kStartFlag, kStartFlagLong, MSyntax::kLong);
+  syntax.addFlag(kEndFlag, kEndFlagLong, MSyntax::kLong);
+  syntax.addFlag(kEncodingFlag, kEncodingFlagLong, MSyntax::kString);
+  syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+  syntax.useSelectionAsDefault(true);
+  return syntax;
+}
+
+MStatus StressMapBake::doIt(const MArgList& argList){
+  MStatus status;
+  MArgDatabase args(syntax(), argList, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+
+  //the stressMap node to bake
+  MSelectionList selection;
+  args.getObjects(selection);
+  MObject nodeObj;
+  selection.getDependNode(0, nodeObj);
+  MFnDependencyNode nodeFn(nodeObj, &status);
+  if(!status || nodeFn.typeId() != StressMap::typeId){
+    displayError("stressMapBake: select or name a stressMap node");
+    return MS::kInvalidParameter;
+  }
+  StressMap* node = static_cast<StressMap*>(nodeFn.userNode());
+
+  if(!args.isFlagSet(kFileFlag)){
+    displayError("stressMapBake: -file is required");
+    return MS::kInvalidParameter;
+  }
+  MString path;
+  args.getFlagArgument(kFileFlag, 0, path);
+
+  //defaults to the playback range
+  int startFrame = static_cast<int>(std::floor(MAnimControl::minTime().as(MTime::uiUnit()) + 0.5));
+  int endFrame = static_cast<int>(std::floor(MAnimControl::maxTime().as(MTime::uiUnit()) + 0.5));
+  if(args.isFlagSet(kStartFlag)) args.getFlagArgument(kStartFlag, 0, startFrame);
+  if(args.isFlagSet(kEndFlag)) args.getFlagArgument(kEndFlag, 0, endFrame);
+  if(endFrame < startFrame){
+    displayError("stressMapBake: the end frame is before the start frame");
+    return MS::kInvalidParameter;
+  }
+
+  StressCacheEncoding encoding = kStressCacheUint8;
+  if(args.isFlagSet(kEncodingFlag)){
+    MString encodingV;
+    args.getFlagArgument(kEncodingFlag, 0, encodingV);
+    if(encodingV == "half") encoding = kStressCacheHalf;
+    else if(encodingV != "uint8"){
+      displayError("stressMapBake: -encoding is uint8 or half");
+      return MS::kInvalidParameter;
+    }
+  }
+
+  //the node looks its frames up by the time input, both for the accumulation and the playback,
+  //an unconnected one is connected to time1 first and reported
+  MPlug timeP(nodeObj, StressMap::time);
+  if(!timeP.isConnected()){
+    MSelectionList timeList;
+    MObject timeObj;
+    if(timeList.add("time1") && timeList.getDependNode(0, timeObj)){
+      MDGModifier modifier;
+      if(modifier.connect(MFnDependencyNode(timeObj).findPlug("outTime", true), timeP) && modifier.doIt()){
+        displayInfo("stressMapBake: connected time1.outTime to " + timeP.name());
+      }
+    }
+    if(!timeP.isConnected()){
+      displayError("stressMapBake: connect a time to " + timeP.name() + " before baking");
+      return MS::kFailure;
+    }
+  }
+
+  //bake the live evaluation, the node must not play back the file while it is rewritten
+  MPlug playbackP(nodeObj, StressMap::playback);
+  const bool playbackV = playbackP.asBool();
+  playbackP.setBool(false);
+  node->closeCache();
+
+  //the frames evaluate through the node itself, so its result, incremental state and temporal accumulation
+  //follow the baked frames, the accumulation starts over at the first frame and again once the bake is done
+  node->resetTemporal();
+
+  //the frames go to a file next to the target, the previous cache is only replaced once every frame is written
+  const std::string target = path.asChar();
+  const std::string partial = target + ".part";
+  MPlug outputP(nodeObj, StressMap::output);
+  StressCacheWriter writer;
+  std::string error;
+  unsigned int vertexCount = 0;
+  unsigned int clusterCount = 0;
+  const unsigned int clusterSizeV = static_cast<unsigned int>(std::max(1, MPlug(nodeObj, StressMap::clusterSize).asInt()));
+  bool ok = true;
+  for(int frame=startFrame; frame<=endFrame && ok; frame++){
+    MDGContext context(MTime(static_cast<double>(frame), MTime::uiUnit()));
+    MDGContextGuard guard(context);
+
+    MFnDoubleArrayData dataFn(outputP.asMObject(), &status);
+    MDoubleArray values = status ? dataFn.array() : MDoubleArray();
+    //the same evaluation measured the bounds of the node's clusters in this pose
+    const std::vector<float>& clusterBounds = node->lastResult()->clusterBounds;
+    if(values.length() == 0){
+      error = "no stress values at frame " + std::to_string(frame);
+      ok = false;
+    }
+    else if(frame == startFrame){
+      vertexCount = values.length();
+      clusterCount = static_cast<unsigned int>(clusterBounds.size() / 6);
+      ok = writer.open(partial, vertexCount, startFrame, encoding, clusterSizeV, clusterCount, error);
+    }
+    else if(values.length() != vertexCount){
+      error = "the point count changed at frame " + std::to_string(frame);
+      ok = false;
+    }
+    else if(clusterBounds.size() != 6 * static_cast<size_t>(clusterCount)){
+      error = "the clusters changed at frame " + std::to_string(frame);
+      ok = false;
+    }
+    if(ok){
+      ok = writer.writeFrame(&values[0], clusterBounds.data(), error);
+    }
+  }
+  ok = writer.close(error) && ok;
+  node->resetTemporal();
+
+  //rename doesn't replace an existing file everywhere, the old cache is removed first when it didn't
+  if(ok && std::rename(partial.c_str(), target.c_str()) != 0){
+    std::remove(target.c_str());
+    if(std::rename(partial.c_str(), target.c_str()) != 0){
+      error = "could not replace " + target;
+      ok = false;
+    }
+  }
+
+  //a failed bake leaves the previous cache and cacheFile as they were, setting playback back dirties the output
+  //so the current time evaluates again, a new cacheFile also makes the node map the file again
+  playbackP.setBool(playbackV);
+  if(!ok){
+    std::remove(partial.c_str());
+    displayError(MString("stressMapBake: ") + error.c_str());
+    return MS::kFailure;
+  }
+  MPlug(nodeObj, StressMap::cacheFile).setString(path);
+
+  setResult(static_cast<int>(writer.frameCount()));
+  return MS::kSuccess;
+}
@@ -0,0 +1,21 @@
+//stressMapBake.h
+//stressMapBake -file path [-startFrame f] [-endFrame f] [-encoding uint8|half] stressMapNode
+//evaluates the node over the frame range and writes the stress values to a cache file the node can play back
+//an unconnected time input is connected to time1 first, a failed bake leaves the previous cache in place
+
+#ifndef stressMapBake_H
+#define stressMapBake_H
+
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+
+class StressMapBake final : public MPxCommand{
+  public:
+    static void* creator() { return new StressMapBake(); };
+    static MSyntax newSyntax();
+
+    MStatus doIt(const MArgList& argList) override;
+    bool isUndoable() const override { return false; };  //the cache file stays written either way
+};
+
+#endif
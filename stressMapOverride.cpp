@@ -4,11 +4,14 @@
 #include <maya/MDagPath.h>
 #include <maya/MDrawContext.h>
 #include <maya/MFnDagNode.h>
-#include <maya/MFnDoubleArrayData.h>
+#include <maya/MFnDependencyNode.h>
 #include <maya/MFnMesh.h>
 #include <maya/MFrameContext.h>
 #include <maya/MHWGeometryUtilities.h>
+#include <maya/MMatrix.h>
 #include <maya/MPointArray.h>
+#include <maya/MProfilingScope.h>
+#include <maya/MUIDrawManager.h>
 #include <maya/MUserData.h>
 #include <maya/MViewport2Renderer.h>
 
@@ -27,24 +30,211 @@ MUserData* StressMapOverride::prepareForDraw(const MDagPath& objPath, const MDag
   Returns:
   an instance of MUserData to be passed to the draw callback and addUIDrawables methodes
   -------------------------------------------------------------------------------------------------- */
+  MProfilingScope profilingScope(StressMap::profilerCategory, MProfiler::kColorB_L1, "prepareForDraw", "points, colors and line indices", objPath.node());
+
   auto* boundsData = dynamic_cast<StressMapUserData*>(data);
   if(!boundsData){
     boundsData = new StressMapUserData();
   }
   MObject obj = objPath.node();
-  MPlug stressPlug{obj, StressMap::output};
-  MFnDoubleArrayData doubleFn;
-  MStatus status;
-  status = doubleFn.setObject(stressPlug.asMObject());
-  CHECK_MSTATUS(status);
 
-  boundsData -> stressData = doubleFn.array(&status);
-  CHECK_MSTATUS(status);
+  //pulling fakeOut makes sure the node evaluated, the results and the trees they were evaluated with
+  //are then read from the node's last result, never from its members that a new evaluation replaces
+  MPlug(obj, StressMap::fakeOut).asBool();
+
+  const StressMap* node = dynamic_cast<const StressMap*>(MFnDependencyNode(obj).userNode());
+  if(!node){
+    return boundsData;
+  }
+  const std::shared_ptr<const StressResult> result = node->lastResult();
+
+  //points and colors only change when the node evaluated again, the color attributes and autoNormalize
+  //affect fakeOut so a new color or scale also shows up as a new evaluation
+  if(result->evaluation != boundsData->evaluation){
+    MPlug squashPlug{obj, StressMap::squashColor};
+    MPlug stretchPlug{obj, StressMap::stretchColor};
+    const MColor squash(squashPlug.child(0).asFloat(), squashPlug.child(1).asFloat(), squashPlug.child(2).asFloat());
+    const MColor stretch(stretchPlug.child(0).asFloat(), stretchPlug.child(1).asFloat(), stretchPlug.child(2).asFloat());
+    const float intensityV = MPlug(obj, StressMap::intensity).asFloat();
+    //auto normalize remaps by the stats of the same pass, the color loop below is the only sweep
+    const bool autoNormalizeV = MPlug(obj, StressMap::autoNormalize).asBool();
+    const double scale = autoNormalizeV ? result->stats.autoScale() : 1.0;
+
+    const double* stress = result->stress;
+    const StressPositions& points = result->points;
+    const StressFloatPositions& floatPoints = result->floatPoints;
+    const bool floatInput = result->length != 0 && result->length == floatPoints.size();
+    unsigned int stressSize = result->length == points.size() || floatInput ? result->length : 0;
+
+    //baked playback doesn't read the input mesh, the positions come straight from it here
+    MObject inputMeshV;
+    const float* rawPoints = nullptr;
+    if(result->length != points.size() && !floatInput){
+      inputMeshV = MPlug(obj, StressMap::inputMesh).asMObject();
+      MFnMesh meshFn(inputMeshV);
+      if(!inputMeshV.isNull() && static_cast<unsigned int>(meshFn.numVertices()) == result->length){
+        rawPoints = meshFn.getRawPoints(nullptr);
+        stressSize = rawPoints ? result->length : 0;
+      }
+    }
+    if(!result->topology || stressSize != result->topology->numVertices()) stressSize = 0;
+
+    //the output mesh shows the single pair in the shaded pipeline, only the batch is left to draw here
+    if(MPlug(obj, StressMap::outMesh).isConnected()) stressSize = 0;
+
+    //a masked evaluation only draws the vertices and edges of its region of interest
+    const StressMask* mask = stressSize != 0 && !rawPoints ? result->mask.get() : nullptr;
+    const unsigned int pairSize = mask ? static_cast<unsigned int>(mask->vertices.size()) : stressSize;
+
+    //the single pair and every batch mesh go into the same arrays and are drawn by one call,
+    //a mesh without values or with a tree of another size is left out
+    const size_t numPieces = 1 + result->batch.size();
+    boundsData->pieceLengths.resize(numPieces);
+    boundsData->pieceLengths[0] = pairSize;
+    unsigned int totalSize = pairSize;
+    for(size_t i=0; i<result->batch.size(); i++){
+      const StressMeshResult& mesh = result->batch[i];
+      const bool drawn = mesh.length == mesh.points.size() && mesh.topology && mesh.length == mesh.topology->numVertices();
+      boundsData->pieceLengths[i + 1] = drawn ? mesh.length : 0;
+      totalSize += boundsData->pieceLengths[i + 1];
+    }
 
-  MFnMesh meshFn;
-  MPlug meshPlug{obj, StressMap::inputMesh};
-  meshFn.setObject(meshPlug.asMObject());
-  meshFn.getPoints(boundsData->meshPoints);
+    //the arrays are only resized when the point count changes
+    if(boundsData->colors.length() != totalSize){
+      boundsData->colors.setLength(totalSize);
+      boundsData->meshPoints.setLength(totalSize);
+    }
+
+    //quantized colors come from a table of 256 steps over the range the stats already hold,
+    //each vertex then only picks its step instead of going through stressColor
+    const bool quantizeV = MPlug(obj, StressMap::quantizeColors).asBool() && pairSize != 0;
+    float quantOffset = 0.0f;
+    float quantScale = 0.0f;
+    MColor quantColors[256];
+    if(quantizeV){
+      stressUint8Range(result->stats.minimum, result->stats.maximum, quantOffset, quantScale);
+      for(unsigned int q=0; q<256; q++){
+        quantColors[q] = stressColor((quantOffset + static_cast<double>(q) * quantScale) * scale, squash, stretch, intensityV);
+      }
+    }
+
+    for(unsigned int i=0; i<pairSize; i++){
+      const unsigned int v = mask ? mask->vertices[i] : i;
+      boundsData->meshPoints[i] = rawPoints ? MPoint(rawPoints[3 * v], rawPoints[3 * v + 1], rawPoints[3 * v + 2]) :
+                                  floatInput ? MPoint(floatPoints.x[v], floatPoints.y[v], floatPoints.z[v]) :
+                                               MPoint(points.x[v], points.y[v], points.z[v]);
+      if(quantizeV){
+        unsigned char q;
+        stressEncodeUint8(stress + v, 1, quantOffset, quantScale, &q);
+        boundsData->colors[i] = quantColors[q];
+      }
+      else boundsData->colors[i] = stressColor(stress[v] * scale, squash, stretch, intensityV);
+    }
+    unsigned int offset = pairSize;
+    for(size_t p=1; p<numPieces; p++){
+      const StressMeshResult& mesh = result->batch[p - 1];
+      const double meshScale = autoNormalizeV ? mesh.stats.autoScale() : 1.0;
+      for(unsigned int i=0; i<boundsData->pieceLengths[p]; i++){
+        boundsData->meshPoints[offset + i] = MPoint(mesh.points.x[i], mesh.points.y[i], mesh.points.z[i]);
+        boundsData->colors[offset + i] = stressColor(mesh.stress[i] * meshScale, squash, stretch, intensityV);
+      }
+      offset += boundsData->pieceLengths[p];
+    }
+
+    //a masked or baked pair keeps every edge, otherwise the clusters must match the points and the bounds
+    boundsData->clustered = !mask && pairSize != 0 && result->clusters && result->clusters->vertices.size() == pairSize &&
+                            result->clusterBounds.size() == 6 * static_cast<size_t>(result->clusters->numClusters());
+    boundsData->maskVersion = mask ? result->maskVersion : 0;
+    boundsData->evaluation = result->evaluation;
+  }
+
+  //the clusters follow the camera so they are classified for every draw, their bounds are in the locator's space
+  if(boundsData->clustered){
+    int originX = 0;
+    int originY = 0;
+    int width = 0;
+    int height = 0;
+    frameContext.getViewportDimensions(originX, originY, width, height);
+    const MMatrix viewProjection = objPath.inclusiveMatrix() * frameContext.getMatrix(MHWRender::MFrameContext::kViewProjMtx);
+    boundsData->clusterStates.resize(result->clusters->numClusters());
+    stressClassifyClusters(result->clusterBounds, viewProjection.matrix[0], width, height,
+                           MPlug(obj, StressMap::frustumCulling).asBool(), MPlug(obj, StressMap::lodPixels).asDouble(),
+                           boundsData->clusterStates.data());
+  }
+  else{
+    boundsData->clusterStates.clear();
+  }
+
+  //line indices come from the unique edge lists and only change with the topology, the mask, the pieces drawn
+  //or the state of a cluster, a clustered pair then also draws only the points of what it keeps
+  const StressMask* mask = boundsData->maskVersion != 0 ? result->mask.get() : nullptr;
+  if(result->topologyVersion != boundsData->topologyVersion || result->batchTopologyVersion != boundsData->batchTopologyVersion ||
+     boundsData->maskVersion != boundsData->lineMaskVersion ||
+     boundsData->pieceLengths != boundsData->linePieceLengths || boundsData->clusterStates != boundsData->lineClusterStates ||
+     (boundsData->clustered && result->clusterVersion != boundsData->clusterVersion)){
+    const size_t numPieces = boundsData->pieceLengths.size();
+    std::vector<unsigned int>& clusterIndices = boundsData->clusterIndices;
+    if(boundsData->clustered){
+      stressClusterLines(*result->clusters, *result->topology, boundsData->clusterStates.data(), clusterIndices);
+    }
+    const std::vector<unsigned int>* pairLines = mask ? &mask->lines : boundsData->clustered ? &clusterIndices : nullptr;
+    unsigned int numEdges = pairLines ? static_cast<unsigned int>(pairLines->size() / 2) : 0;
+    for(size_t p=0; p<numPieces; p++){
+      if(boundsData->pieceLengths[p] == 0 || (p == 0 && pairLines)) continue;
+      numEdges += (p == 0 ? result->topology : result->batch[p - 1].topology)->numEdges();
+    }
+    boundsData->lineIndices.setLength(numEdges * 2);
+    unsigned int line = 0;
+    unsigned int base = 0;
+    if(pairLines){
+      for(const unsigned int index : *pairLines){
+        boundsData->lineIndices[line++] = index;
+      }
+    }
+    for(size_t p=0; p<numPieces; p++){
+      if(boundsData->pieceLengths[p] == 0) continue;
+      if(p == 0 && pairLines){
+        base += boundsData->pieceLengths[p];
+        continue;
+      }
+      const StressTopology& pieceTopology = *(p == 0 ? result->topology : result->batch[p - 1].topology);
+      for(unsigned int e=0; e<pieceTopology.numEdges(); e++){
+        boundsData->lineIndices[line++] = base + pieceTopology.edgeFrom[e];
+        boundsData->lineIndices[line++] = base + pieceTopology.edgeTo[e];
+      }
+      base += boundsData->pieceLengths[p];
+    }
+
+    boundsData->pointIndices.clear();
+    if(boundsData->clustered){
+      stressClusterPoints(*result->clusters, boundsData->clusterStates.data(), clusterIndices);
+      unsigned int numPoints = static_cast<unsigned int>(clusterIndices.size());
+      for(size_t p=1; p<numPieces; p++){
+        numPoints += boundsData->pieceLengths[p];
+      }
+      boundsData->pointIndices.setLength(numPoints);
+      unsigned int point = 0;
+      for(const unsigned int index : clusterIndices){
+        boundsData->pointIndices[point++] = index;
+      }
+      for(unsigned int index=boundsData->pieceLengths[0]; point<numPoints; index++){
+        boundsData->pointIndices[point++] = index;
+      }
+    }
+
+    boundsData->topologyVersion = result->topologyVersion;
+    boundsData->batchTopologyVersion = result->batchTopologyVersion;
+    boundsData->lineMaskVersion = boundsData->maskVersion;
+    boundsData->linePieceLengths = boundsData->pieceLengths;
+    boundsData->lineClusterStates = boundsData->clusterStates;
+    boundsData->clusterVersion = result->clusterVersion;
+  }
+
+  //vertices are only drawn on top of the edges in shaded modes
+  boundsData->drawPoints = (frameContext.getDisplayStyle() &
+    (MHWRender::MFrameContext::kFlatShaded |
+    MHWRender::MFrameContext::kGouraudShaded |
+    MHWRender::MFrameContext::kTextured)) != 0;
 
   boundsData->fPath = objPath;
 
@@ -54,6 +244,10 @@ MUserData* StressMapOverride::prepareForDraw(const MDagPath& objPath, const MDag
   return boundsData;
 }
 
+MBoundingBox StressMapOverride::boundingBox(const MDagPath& objPath, const MDagPath& cameraPath) const{
+  return MFnDagNode(objPath).boundingBox();
+}
+
 void StressMapOverride::addUIDrawables(const MDagPath& objPath, MHWRender::MUIDrawManager& drawManager, const MHWRender::MFrameContext& frameContext, const MUserData* data){
   /* --------------------------------------------------------------------------------------------------
   Add any UI drawables here
@@ -67,35 +261,38 @@ void StressMapOverride::addUIDrawables(const MDagPath& objPath, MHWRender::MUIDr
   Returns:
   an instance of MUserData to be passed to the draw callback and addUIDrawables methodes
   -------------------------------------------------------------------------------------------------- */
+  MProfilingScope profilingScope(StressMap::profilerCategory, MProfiler::kColorB_L2, "addUIDrawables", "batched lines and points");
+
   const auto* boundsData = dynamic_cast<const StressMapUserData*>(data);
   if(!boundsData){
     return;  //can't draw anything
   }
 
-  const MHWRender::DisplayStatus displayStatus = MHWRender::MGeometryUtilities::displayStatus(objPath);
-  const MDoubleArray& stress = boundsData->stressData;
   const MPointArray& points = boundsData->meshPoints;
-  const unsigned int stressSize = stress.length();
   const unsigned int pointsSize = points.length();
 
   //check to make sure the points are all the same size
-  if(stressSize != pointsSize) return;
+  if(boundsData->colors.length() != pointsSize) return;
 
+  //the whole map goes out in one batched call per primitive type instead of a drawable per vertex
   drawManager.beginDrawable();
   {
-    if(frameContext.getDisplayStyle() &
-      (MHWRender::MFrameContext::kFlatShaded |
-      MHWRender::MFrameContext::kGouraudShaded |
-      MHWRender::MFrameContext::kTextured)){
-        const unsigned int len = points.length();
-        MColor green = MColor(0.0, 1.0f, 0.0, 1.0f);
-        MColor red = MColor(1.0f, 0.0, 0.0, 1.0f);
-        for(unsigned int i=0; i<pointsSize; ++i){
-          MColor color = stress[i] > 0.0f ? stress[i] * green : (-stress[i]) * (red);
-          drawManager.setColor(color);
-          drawManager.sphere(points[i], 0.2f, 5, 5, true);
-        }
+    drawManager.setLineWidth(2.0f);
+    if(boundsData->lineIndices.length() != 0){
+      drawManager.mesh(MHWRender::MUIDrawManager::kLines, points, nullptr, &boundsData->colors, &boundsData->lineIndices);
+    }
+
+    //a clustered pair only draws the points of what it kept in this view
+    if(boundsData->drawPoints && boundsData->clustered){
+      drawManager.setPointSize(4.0f);
+      if(boundsData->pointIndices.length() != 0){
+        drawManager.mesh(MHWRender::MUIDrawManager::kPoints, points, nullptr, &boundsData->colors, &boundsData->pointIndices);
       }
-  drawManager.endDrawable();
+    }
+    else if(boundsData->drawPoints){
+      drawManager.setPointSize(4.0f);
+      drawManager.mesh(MHWRender::MUIDrawManager::kPoints, points, nullptr, &boundsData->colors);
+    }
   }
+  drawManager.endDrawable();
 }
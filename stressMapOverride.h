@@ -2,17 +2,35 @@
 #include <maya/MBoundingBox.h>
 #include <maya/MPxDrawOverride.h>
 #include <maya/MPointArray.h>
+#include <maya/MColorArray.h>
+#include <maya/MUintArray.h>
+#include <vector>
 
 //this class can not be iterated from
 class StressMapOverride final : public ::MPxDrawOverride{
 private:
   class StressMapUserData final : public MUserData{
   public:
-    StressMapUserData() : MUserData(false){}
+    StressMapUserData() : MUserData(false), topologyVersion(0), batchTopologyVersion(0), maskVersion(0), lineMaskVersion(0), clusterVersion(0), evaluation(0), clustered(false), drawPoints(false){}
     virtual ~StressMapUserData() = default;
 
-    MDoubleArray stressData;
     MPointArray meshPoints;
+    MColorArray colors;  //per vertex stress color, updated in place every frame
+    MUintArray lineIndices;  //two vertices per edge, only rebuilt when the topology changes
+    MUintArray pointIndices;  //vertices drawn as points while the single pair is clustered, empty draws every point
+    unsigned int topologyVersion;  //version of the node's connection tree lineIndices was built from
+    unsigned int batchTopologyVersion;  //version of the batch trees lineIndices was built from
+    unsigned int maskVersion;  //version of the node's mask the points were gathered with, 0 when unmasked
+    unsigned int lineMaskVersion;  //maskVersion lineIndices was built for
+    std::vector<unsigned int> pieceLengths;  //points of the single pair then of every batch mesh, 0 when not drawn
+    std::vector<unsigned int> linePieceLengths;  //pieceLengths lineIndices was built for
+    std::vector<unsigned char> clusterStates;  //state of every cluster of the single pair in the current view
+    std::vector<unsigned char> lineClusterStates;  //clusterStates lineIndices was built for
+    unsigned int clusterVersion;  //version of the node's clusters lineIndices was built from
+    std::vector<unsigned int> clusterIndices;  //scratch of the clustered lines and points
+    unsigned long long evaluation;  //node evaluation the points and colors come from
+    bool clustered;  //the single pair is drawn by clusters, culled and coarsened per view
+    bool drawPoints;
     MBoundingBox fBounds;
     MDagPath fPath;
   };
@@ -27,6 +45,10 @@ public:
   //extract all needed data for rendering
   MUserData* prepareForDraw(const MDagPath& objPath, const MDagPath& cameraPath, const MHWRender::MFrameContext& frameContext, MUserData* data) override;
 
+  //the node's bounds, viewport 2.0 culls the whole locator with them
+  bool isBounded(const MDagPath& objPath, const MDagPath& cameraPath) const override {return true;}
+  MBoundingBox boundingBox(const MDagPath& objPath, const MDagPath& cameraPath) const override;
+
   bool hasUIDrawables() const override {return true;}
   void addUIDrawables(const MDagPath& objPath, MHWRender::MUIDrawManager& drawManager, const MHWRender::MFrameContext& frameContext, const MUserData* data) override;
 
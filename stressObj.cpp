@@ -0,0 +1,110 @@
+//stressObj.cpp
+#include "stressObj.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+static bool readFile(const std::string& path, std::string& text, std::string& error){
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if(!file){
+    error = "can't open " + path;
+    return false;
+  }
+  text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+//parse the records we care about, faceCounts/faceConnects are skipped when null
+static bool parseObj(const std::string& text, StressPositions& points, std::vector<unsigned int>* faceCounts,
+                     std::vector<unsigned int>* faceConnects, std::string& error){
+  points.x.clear();
+  points.y.clear();
+  points.z.clear();
+
+  const char* c = text.c_str();
+  const char* end = c + text.size();
+  unsigned int lineNumber = 1;
+
+  while(c < end){
+    while(c < end && (*c == ' ' || *c == '\t')) c++;
+
+    if(c + 1 < end && c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')){
+      char* next;
+      const double x = std::strtod(c + 2, &next);
+      const double y = std::strtod(next, &next);
+      const double z = std::strtod(next, &next);
+      points.x.push_back(x);
+      points.y.push_back(y);
+      points.z.push_back(z);
+      c = next;
+    }
+    else if(faceCounts && c + 1 < end && c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')){
+      c += 2;
+      unsigned int count = 0;
+      for(;;){
+        while(c < end && (*c == ' ' || *c == '\t')) c++;
+        if(c >= end || *c == '\n' || *c == '\r') break;
+
+        //first number of v, v/vt, v//vn or v/vt/vn, negative values count back from the last vertex
+        char* next;
+        const long index = std::strtol(c, &next, 10);
+        if(next == c){
+          error = "bad face record at line " + std::to_string(lineNumber);
+          return false;
+        }
+        const long resolved = index < 0 ? static_cast<long>(points.size()) + index : index - 1;
+        if(resolved < 0){
+          error = "bad vertex index at line " + std::to_string(lineNumber);
+          return false;
+        }
+        faceConnects->push_back(static_cast<unsigned int>(resolved));
+        count++;
+
+        c = next;
+        while(c < end && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r') c++;
+      }
+      faceCounts->push_back(count);
+    }
+
+    //skip to the next line
+    while(c < end && *c != '\n') c++;
+    if(c < end){
+      c++;
+      lineNumber++;
+    }
+  }
+
+  return true;
+}
+
+bool stressReadObj(const std::string& path, StressObjMesh& mesh, std::string& error){
+  std::string text;
+  if(!readFile(path, text, error)) return false;
+
+  mesh.faceCounts.clear();
+  mesh.faceConnects.clear();
+  if(!parseObj(text, mesh.points, &mesh.faceCounts, &mesh.faceConnects, error)){
+    error = path + ": " + error;
+    return false;
+  }
+
+  for(const unsigned int index : mesh.faceConnects){
+    if(index >= mesh.points.size()){
+      error = path + ": face references a missing vertex";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool stressReadObjPoints(const std::string& path, StressPositions& points, std::string& error){
+  std::string text;
+  if(!readFile(path, text, error)) return false;
+
+  if(!parseObj(text, points, nullptr, nullptr, error)){
+    error = path + ": " + error;
+    return false;
+  }
+  return true;
+}
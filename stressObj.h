@@ -0,0 +1,24 @@
+//stressObj.h
+//minimal wavefront obj reader for the standalone tools, only v and f records are used
+
+#ifndef stressObj_H
+#define stressObj_H
+
+#include <string>
+#include <vector>
+
+#include "stressSimd.h"
+
+struct StressObjMesh{
+  StressPositions points;
+  std::vector<unsigned int> faceCounts;  //vertices per face
+  std::vector<unsigned int> faceConnects;  //vertex ids of every face, zero based
+};
+
+//returns false and fills error when the file can't be read
+bool stressReadObj(const std::string& path, StressObjMesh& mesh, std::string& error);
+
+//only the positions, for deformed poses sharing the reference topology
+bool stressReadObjPoints(const std::string& path, StressPositions& points, std::string& error);
+
+#endif
@@ -0,0 +1,75 @@
+//stressParallel.cpp
+#include "stressParallel.h"
+
+//set on the pool's own threads so a loop they run never waits on the pool
+static thread_local bool poolWorker = false;
+
+StressThreadPool::StressThreadPool() : busy(false), stopping(false), generation(0), job(nullptr), jobContext(nullptr), jobHelpers(0), pending(0){ }
+
+StressThreadPool::~StressThreadPool(){
+  stop();
+}
+
+StressThreadPool& StressThreadPool::instance(){
+  static StressThreadPool pool;
+  return pool;
+}
+
+bool StressThreadPool::run(unsigned int helpers, void (*work)(void*), void* context){
+  if(poolWorker || busy.exchange(true)) return false;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = false;
+    //threads are only started the first time a loop asks for this many
+    while(workers.size() < helpers){
+      const unsigned int index = static_cast<unsigned int>(workers.size());
+      workers.emplace_back([this, index](){ workerLoop(index); });
+    }
+    job = work;
+    jobContext = context;
+    jobHelpers = helpers;
+    pending = helpers;
+    generation++;
+  }
+  wake.notify_all();
+
+  work(context);  //the calling thread works too
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this](){ return pending == 0; });
+  }
+  busy = false;
+  return true;
+}
+
+void StressThreadPool::stop(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(std::thread& worker : workers){
+    worker.join();
+  }
+  workers.clear();
+}
+
+void StressThreadPool::workerLoop(unsigned int index){
+  poolWorker = true;
+  unsigned long long seen = 0;
+  std::unique_lock<std::mutex> guard(lock);
+  for(;;){
+    //a loop that needs fewer helpers leaves the workers past its count asleep
+    wake.wait(guard, [&](){ return stopping || (generation != seen && index < jobHelpers); });
+    if(stopping) return;
+    seen = generation;
+
+    guard.unlock();
+    job(jobContext);
+    guard.lock();
+
+    if(--pending == 0) finished.notify_one();
+  }
+}
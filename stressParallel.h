@@ -0,0 +1,98 @@
+//stressParallel.h
+
+#ifndef stressParallel_H
+#define stressParallel_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//number of threads to use when the user asks for 0 (all cores)
+inline unsigned int stressHardwareThreads(){
+  const unsigned int count = std::thread::hardware_concurrency();
+  return count > 0 ? count : 1;
+}
+
+//workers kept alive between parallel loops, they sleep until the next loop wakes them
+//so a loop pays for a wake up, never for starting threads or allocating
+class StressThreadPool{
+  public:
+    static StressThreadPool& instance();
+    ~StressThreadPool();
+
+    //runs work(context) on the calling thread and on helpers workers at once and returns when all of them are done,
+    //returns false without running anything when the pool is busy with another loop or this is one of its workers
+    bool run(unsigned int helpers, void (*work)(void*), void* context);
+
+    //joins the workers, the plugin calls this before it is unloaded, the next run starts them again
+    void stop();
+
+  private:
+    StressThreadPool();
+    void workerLoop(unsigned int index);
+
+    std::mutex lock;
+    std::condition_variable wake;  //a new loop or stop
+    std::condition_variable finished;  //the last helper is done
+    std::vector<std::thread> workers;
+    std::atomic<bool> busy;  //a loop is running, a second one runs on its own thread
+    bool stopping;
+    unsigned long long generation;  //bumped for every loop
+    void (*job)(void*);
+    void* jobContext;
+    unsigned int jobHelpers;  //workers below this index take part in the loop
+    unsigned int pending;  //helpers still working on it
+};
+
+//run fn(chunk, begin, end) over [0, count) split in chunks of grainSize items
+//chunk boundaries only depend on grainSize, never on the thread count, so a kernel
+//that writes per item (or reduces per chunk) gives the same bits on any number of threads
+//a single chunk, or a single thread, runs inline without waking anything
+template<typename Func>
+void stressParallelFor(unsigned int count, unsigned int grainSize, unsigned int numThreads, const Func& fn){
+  if(grainSize == 0) grainSize = 1;
+  const unsigned int numChunks = count / grainSize + (count % grainSize != 0 ? 1 : 0);
+
+  if(numThreads == 0) numThreads = stressHardwareThreads();
+  if(numThreads > numChunks) numThreads = numChunks;
+
+  //serial path, small meshes end up here
+  if(numThreads <= 1){
+    for(unsigned int c=0; c<numChunks; c++){
+      const unsigned int begin = c * grainSize;
+      const unsigned int end = begin + grainSize < count ? begin + grainSize : count;
+      fn(c, begin, end);
+    }
+    return;
+  }
+
+  //every thread keeps grabbing the next free chunk, the loop's state lives on this stack
+  struct Loop{
+    const Func* fn;
+    unsigned int count;
+    unsigned int grainSize;
+    unsigned int numChunks;
+    std::atomic<unsigned int> nextChunk;
+
+    static void work(void* context){
+      Loop& loop = *static_cast<Loop*>(context);
+      for(;;){
+        const unsigned int c = loop.nextChunk.fetch_add(1);
+        if(c >= loop.numChunks) break;
+        const unsigned int begin = c * loop.grainSize;
+        const unsigned int end = begin + loop.grainSize < loop.count ? begin + loop.grainSize : loop.count;
+        (*loop.fn)(c, begin, end);
+      }
+    }
+  };
+  Loop loop{&fn, count, grainSize, numChunks, {0}};
+
+  //a loop inside a loop, or one started while another node's loop is running, takes all its chunks itself
+  if(!StressThreadPool::instance().run(numThreads - 1, &Loop::work, &loop)){
+    Loop::work(&loop);
+  }
+}
+
+#endif
@@ -0,0 +1,411 @@
+//stressSimd.cpp
+#include "stressSimd.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define STRESS_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#    define STRESS_TARGET_AVX2
+#  else
+#    define STRESS_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#endif
+
+static void edgeRatiosScalar(const StressPositions& points, const unsigned int* from, const unsigned int* to,
+                             const double* invRest, double* ratios, unsigned int begin, unsigned int end){
+  const double* x = points.x.data();
+  const double* y = points.y.data();
+  const double* z = points.z.data();
+
+  for(unsigned int e=begin; e<end; e++){
+    const double dx = x[to[e]] - x[from[e]];
+    const double dy = y[to[e]] - y[from[e]];
+    const double dz = z[to[e]] - z[from[e]];
+    ratios[e] = std::sqrt(dx * dx + dy * dy + dz * dz) * invRest[e];
+  }
+}
+
+static void edgeRatiosFloatScalar(const StressFloatPositions& points, const unsigned int* from, const unsigned int* to,
+                                  const float* invRest, float* ratios, unsigned int begin, unsigned int end){
+  const float* x = points.x.data();
+  const float* y = points.y.data();
+  const float* z = points.z.data();
+
+  for(unsigned int e=begin; e<end; e++){
+    const float dx = x[to[e]] - x[from[e]];
+    const float dy = y[to[e]] - y[from[e]];
+    const float dz = z[to[e]] - z[from[e]];
+    ratios[e] = std::sqrt(dx * dx + dy * dy + dz * dz) * invRest[e];
+  }
+}
+
+static unsigned int detectMovedScalar(const StressPositions& points, StressPositions& previous, double epsilon,
+                                      unsigned char* moved, unsigned int begin, unsigned int end){
+  const double* x = points.x.data();
+  const double* y = points.y.data();
+  const double* z = points.z.data();
+  double* px = previous.x.data();
+  double* py = previous.y.data();
+  double* pz = previous.z.data();
+
+  unsigned int count = 0;
+  for(unsigned int i=begin; i<end; i++){
+    const bool hasMoved = std::fabs(x[i] - px[i]) > epsilon || std::fabs(y[i] - py[i]) > epsilon || std::fabs(z[i] - pz[i]) > epsilon;
+    moved[i] = hasMoved ? 1 : 0;
+    if(hasMoved){
+      px[i] = x[i];
+      py[i] = y[i];
+      pz[i] = z[i];
+      count++;
+    }
+  }
+  return count;
+}
+
+//every lane mixes in one value of each block of eight, lane j starts from its own seed
+static const uint32_t kHashPrime = 0x9e3779b1u;
+static const uint32_t kHashSeed = 0x811c9dc5u;
+static const uint32_t kHashSeedStep = 0x01000193u;
+
+static inline uint32_t hashLane(uint32_t lane, uint32_t value){
+  lane = (lane ^ value) * kHashPrime;
+  return lane ^ (lane >> 15);
+}
+
+//folds the lanes and the values past the last full block into 64 bits
+static uint64_t hashFinish(const uint32_t* lanes, const unsigned int* values, unsigned int begin, unsigned int count){
+  uint64_t hash = 0xcbf29ce484222325ull ^ count;
+  for(unsigned int j=0; j<8; j++){
+    hash = (hash ^ lanes[j]) * 0x100000001b3ull;
+  }
+  for(unsigned int i=begin; i<count; i++){
+    hash = (hash ^ values[i]) * 0x100000001b3ull;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static uint64_t hashScalar(const unsigned int* values, unsigned int count){
+  uint32_t lanes[8];
+  for(unsigned int j=0; j<8; j++){
+    lanes[j] = kHashSeed + j * kHashSeedStep;
+  }
+  unsigned int i = 0;
+  for(; i + 8 <= count; i += 8){
+    for(unsigned int j=0; j<8; j++){
+      lanes[j] = hashLane(lanes[j], values[i + j]);
+    }
+  }
+  return hashFinish(lanes, values, i, count);
+}
+
+#ifdef STRESS_X86
+//sse2 has no 32 bit multiply that keeps the low halves, it is put together from two 64 bit ones
+static inline __m128i mulLo32(__m128i a, __m128i b){
+  const __m128i even = _mm_mul_epu32(a, b);
+  const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static uint64_t hashSse2(const unsigned int* values, unsigned int count){
+  const __m128i prime = _mm_set1_epi32(static_cast<int>(kHashPrime));
+  __m128i low = _mm_setr_epi32(static_cast<int>(kHashSeed), static_cast<int>(kHashSeed + kHashSeedStep),
+                               static_cast<int>(kHashSeed + 2 * kHashSeedStep), static_cast<int>(kHashSeed + 3 * kHashSeedStep));
+  __m128i high = _mm_add_epi32(low, _mm_set1_epi32(static_cast<int>(4 * kHashSeedStep)));
+
+  unsigned int i = 0;
+  for(; i + 8 <= count; i += 8){
+    low = mulLo32(_mm_xor_si128(low, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i))), prime);
+    high = mulLo32(_mm_xor_si128(high, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 4))), prime);
+    low = _mm_xor_si128(low, _mm_srli_epi32(low, 15));
+    high = _mm_xor_si128(high, _mm_srli_epi32(high, 15));
+  }
+
+  uint32_t lanes[8];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), low);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4), high);
+  return hashFinish(lanes, values, i, count);
+}
+
+//sse2 has no gather, the loads are scalar but the math runs two edges at a time
+static void edgeRatiosSse2(const StressPositions& points, const unsigned int* from, const unsigned int* to,
+                           const double* invRest, double* ratios, unsigned int begin, unsigned int end){
+  const double* x = points.x.data();
+  const double* y = points.y.data();
+  const double* z = points.z.data();
+
+  unsigned int e = begin;
+  for(; e + 2 <= end; e += 2){
+    const unsigned int a0 = from[e], a1 = from[e+1];
+    const unsigned int b0 = to[e], b1 = to[e+1];
+
+    const __m128d dx = _mm_sub_pd(_mm_set_pd(x[b1], x[b0]), _mm_set_pd(x[a1], x[a0]));
+    const __m128d dy = _mm_sub_pd(_mm_set_pd(y[b1], y[b0]), _mm_set_pd(y[a1], y[a0]));
+    const __m128d dz = _mm_sub_pd(_mm_set_pd(z[b1], z[b0]), _mm_set_pd(z[a1], z[a0]));
+
+    const __m128d len2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+    _mm_storeu_pd(ratios + e, _mm_mul_pd(_mm_sqrt_pd(len2), _mm_loadu_pd(invRest + e)));
+  }
+
+  edgeRatiosScalar(points, from, to, invRest, ratios, e, end);
+}
+
+//four edges at a time in single precision
+static void edgeRatiosFloatSse2(const StressFloatPositions& points, const unsigned int* from, const unsigned int* to,
+                                const float* invRest, float* ratios, unsigned int begin, unsigned int end){
+  const float* x = points.x.data();
+  const float* y = points.y.data();
+  const float* z = points.z.data();
+
+  unsigned int e = begin;
+  for(; e + 4 <= end; e += 4){
+    const unsigned int a0 = from[e], a1 = from[e+1], a2 = from[e+2], a3 = from[e+3];
+    const unsigned int b0 = to[e], b1 = to[e+1], b2 = to[e+2], b3 = to[e+3];
+
+    const __m128 dx = _mm_sub_ps(_mm_setr_ps(x[b0], x[b1], x[b2], x[b3]), _mm_setr_ps(x[a0], x[a1], x[a2], x[a3]));
+    const __m128 dy = _mm_sub_ps(_mm_setr_ps(y[b0], y[b1], y[b2], y[b3]), _mm_setr_ps(y[a0], y[a1], y[a2], y[a3]));
+    const __m128 dz = _mm_sub_ps(_mm_setr_ps(z[b0], z[b1], z[b2], z[b3]), _mm_setr_ps(z[a0], z[a1], z[a2], z[a3]));
+
+    const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    _mm_storeu_ps(ratios + e, _mm_mul_ps(_mm_sqrt_ps(len2), _mm_loadu_ps(invRest + e)));
+  }
+
+  edgeRatiosFloatScalar(points, from, to, invRest, ratios, e, end);
+}
+
+//masked form with an explicit source, the plain gather trips gcc's uninitialized warning
+STRESS_TARGET_AVX2
+static inline __m256d gather4(const double* base, __m128i index){
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, all, 8);
+}
+
+//four edges per instruction, the end points are fetched with hardware gathers
+STRESS_TARGET_AVX2
+static void edgeRatiosAvx2(const StressPositions& points, const unsigned int* from, const unsigned int* to,
+                           const double* invRest, double* ratios, unsigned int begin, unsigned int end){
+  const double* x = points.x.data();
+  const double* y = points.y.data();
+  const double* z = points.z.data();
+
+  unsigned int e = begin;
+  for(; e + 4 <= end; e += 4){
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + e));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + e));
+
+    const __m256d dx = _mm256_sub_pd(gather4(x, b), gather4(x, a));
+    const __m256d dy = _mm256_sub_pd(gather4(y, b), gather4(y, a));
+    const __m256d dz = _mm256_sub_pd(gather4(z, b), gather4(z, a));
+
+    //no fma on purpose, keeps the rounding identical to the scalar kernel
+    const __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+    _mm256_storeu_pd(ratios + e, _mm256_mul_pd(_mm256_sqrt_pd(len2), _mm256_loadu_pd(invRest + e)));
+  }
+
+  edgeRatiosScalar(points, from, to, invRest, ratios, e, end);
+}
+
+STRESS_TARGET_AVX2
+static inline __m256 gather8(const float* base, __m256i index){
+  const __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index, all, 4);
+}
+
+//eight edges per instruction, twice the double kernel
+STRESS_TARGET_AVX2
+static void edgeRatiosFloatAvx2(const StressFloatPositions& points, const unsigned int* from, const unsigned int* to,
+                                const float* invRest, float* ratios, unsigned int begin, unsigned int end){
+  const float* x = points.x.data();
+  const float* y = points.y.data();
+  const float* z = points.z.data();
+
+  unsigned int e = begin;
+  for(; e + 8 <= end; e += 8){
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from + e));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(to + e));
+
+    const __m256 dx = _mm256_sub_ps(gather8(x, b), gather8(x, a));
+    const __m256 dy = _mm256_sub_ps(gather8(y, b), gather8(y, a));
+    const __m256 dz = _mm256_sub_ps(gather8(z, b), gather8(z, a));
+
+    const __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    _mm256_storeu_ps(ratios + e, _mm256_mul_ps(_mm256_sqrt_ps(len2), _mm256_loadu_ps(invRest + e)));
+  }
+
+  edgeRatiosFloatScalar(points, from, to, invRest, ratios, e, end);
+}
+
+//four points per compare, the previous positions are only written where something moved
+STRESS_TARGET_AVX2
+static unsigned int detectMovedAvx2(const StressPositions& points, StressPositions& previous, double epsilon,
+                                    unsigned char* moved, unsigned int begin, unsigned int end){
+  const double* x = points.x.data();
+  const double* y = points.y.data();
+  const double* z = points.z.data();
+  double* px = previous.x.data();
+  double* py = previous.y.data();
+  double* pz = previous.z.data();
+
+  const __m256d eps = _mm256_set1_pd(epsilon);
+  const __m256d sign = _mm256_set1_pd(-0.0);
+
+  unsigned int count = 0;
+  unsigned int i = begin;
+  for(; i + 4 <= end; i += 4){
+    const __m256d cx = _mm256_loadu_pd(x + i);
+    const __m256d cy = _mm256_loadu_pd(y + i);
+    const __m256d cz = _mm256_loadu_pd(z + i);
+    const __m256d ox = _mm256_loadu_pd(px + i);
+    const __m256d oy = _mm256_loadu_pd(py + i);
+    const __m256d oz = _mm256_loadu_pd(pz + i);
+
+    //|current - previous| > epsilon on any axis
+    __m256d mask = _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(cx, ox)), eps, _CMP_GT_OQ);
+    mask = _mm256_or_pd(mask, _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(cy, oy)), eps, _CMP_GT_OQ));
+    mask = _mm256_or_pd(mask, _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(cz, oz)), eps, _CMP_GT_OQ));
+
+    const int bits = _mm256_movemask_pd(mask);
+    moved[i] = bits & 1;
+    moved[i+1] = (bits >> 1) & 1;
+    moved[i+2] = (bits >> 2) & 1;
+    moved[i+3] = (bits >> 3) & 1;
+
+    if(bits){
+      _mm256_storeu_pd(px + i, _mm256_blendv_pd(ox, cx, mask));
+      _mm256_storeu_pd(py + i, _mm256_blendv_pd(oy, cy, mask));
+      _mm256_storeu_pd(pz + i, _mm256_blendv_pd(oz, cz, mask));
+      count += moved[i] + moved[i+1] + moved[i+2] + moved[i+3];
+    }
+  }
+
+  return count + detectMovedScalar(points, previous, epsilon, moved, i, end);
+}
+
+//all eight lanes in one register
+STRESS_TARGET_AVX2
+static uint64_t hashAvx2(const unsigned int* values, unsigned int count){
+  const __m256i prime = _mm256_set1_epi32(static_cast<int>(kHashPrime));
+  __m256i hash = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(kHashSeed)),
+                                  _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(kHashSeedStep))));
+
+  unsigned int i = 0;
+  for(; i + 8 <= count; i += 8){
+    hash = _mm256_mullo_epi32(_mm256_xor_si256(hash, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i))), prime);
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15));
+  }
+
+  uint32_t lanes[8];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), hash);
+  return hashFinish(lanes, values, i, count);
+}
+
+static bool cpuHasAvx2(){
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7) return false;
+
+  //avx needs the os to save the ymm registers too
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if(!osxsave || !avx || ((_xgetbv(0) & 6) != 6)) return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+StressSimdLevel stressBestSimdLevel(){
+#ifdef STRESS_X86
+  static const StressSimdLevel level = cpuHasAvx2() ? kStressAvx2 : kStressSse2;
+  return level;
+#else
+  return kStressScalar;
+#endif
+}
+
+const char* stressSimdLevelName(StressSimdLevel level){
+  switch(level){
+    case kStressAvx2: return "avx2";
+    case kStressSse2: return "sse2";
+    default: return "scalar";
+  }
+}
+
+StressEdgeRatioKernel stressEdgeRatioKernel(StressSimdLevel level){
+#ifdef STRESS_X86
+  if(level >= kStressAvx2 && stressBestSimdLevel() >= kStressAvx2) return edgeRatiosAvx2;
+  if(level >= kStressSse2) return edgeRatiosSse2;
+#endif
+  return edgeRatiosScalar;
+}
+
+StressEdgeRatioFloatKernel stressEdgeRatioFloatKernel(StressSimdLevel level){
+#ifdef STRESS_X86
+  if(level >= kStressAvx2 && stressBestSimdLevel() >= kStressAvx2) return edgeRatiosFloatAvx2;
+  if(level >= kStressSse2) return edgeRatiosFloatSse2;
+#endif
+  return edgeRatiosFloatScalar;
+}
+
+StressDetectKernel stressDetectKernel(StressSimdLevel level){
+#ifdef STRESS_X86
+  if(level >= kStressAvx2 && stressBestSimdLevel() >= kStressAvx2) return detectMovedAvx2;
+#endif
+  return detectMovedScalar;
+}
+
+StressHashKernel stressHashKernel(StressSimdLevel level){
+#ifdef STRESS_X86
+  if(level >= kStressAvx2 && stressBestSimdLevel() >= kStressAvx2) return hashAvx2;
+  if(level >= kStressSse2) return hashSse2;
+#endif
+  return hashScalar;
+}
+
+void stressLoadPositions(const float* xyz, StressPositions& points, unsigned int begin, unsigned int end){
+  double* x = points.x.data();
+  double* y = points.y.data();
+  double* z = points.z.data();
+
+  for(unsigned int i=begin; i<end; i++){
+    x[i] = xyz[3 * i];
+    y[i] = xyz[3 * i + 1];
+    z[i] = xyz[3 * i + 2];
+  }
+}
+
+void stressLoadPositions(const float* xyz, StressFloatPositions& points, unsigned int begin, unsigned int end){
+  float* x = points.x.data();
+  float* y = points.y.data();
+  float* z = points.z.data();
+
+  for(unsigned int i=begin; i<end; i++){
+    x[i] = xyz[3 * i];
+    y[i] = xyz[3 * i + 1];
+    z[i] = xyz[3 * i + 2];
+  }
+}
+
+void stressGatherPositions(const float* xyz, StressPositions& points, const unsigned int* indices, unsigned int count){
+  double* x = points.x.data();
+  double* y = points.y.data();
+  double* z = points.z.data();
+
+  for(unsigned int i=0; i<count; i++){
+    const unsigned int v = indices[i];
+    x[v] = xyz[3 * v];
+    y[v] = xyz[3 * v + 1];
+    z[v] = xyz[3 * v + 2];
+  }
+}
@@ -0,0 +1,68 @@
+//stressSimd.h
+
+#ifndef stressSimd_H
+#define stressSimd_H
+
+#include <cstdint>
+#include <vector>
+
+//point positions stored as a structure of arrays so a kernel can load several at once
+struct StressPositions{
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> z;
+
+  unsigned int size() const { return static_cast<unsigned int>(x.size()); };
+  void resize(unsigned int count) { x.resize(count); y.resize(count); z.resize(count); };
+};
+
+//single precision copy, half the memory traffic, maya hands the points over as floats anyway
+struct StressFloatPositions{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  unsigned int size() const { return static_cast<unsigned int>(x.size()); };
+  void resize(unsigned int count) { x.resize(count); y.resize(count); z.resize(count); };
+};
+
+//instruction sets the kernels are written for
+enum StressSimdLevel{
+  kStressScalar = 0,
+  kStressSse2,
+  kStressAvx2
+};
+
+//ratios[e] = |p[to[e]] - p[from[e]]| * invRest[e] for every e in [begin, end)
+typedef void (*StressEdgeRatioKernel)(const StressPositions& points, const unsigned int* from, const unsigned int* to,
+                                      const double* invRest, double* ratios, unsigned int begin, unsigned int end);
+
+//same in single precision
+typedef void (*StressEdgeRatioFloatKernel)(const StressFloatPositions& points, const unsigned int* from, const unsigned int* to,
+                                           const float* invRest, float* ratios, unsigned int begin, unsigned int end);
+
+//moved[i] = 1 when point i is more than epsilon away from previous on any axis, 0 otherwise
+//moved points are copied into previous, returns how many points of [begin, end) moved
+typedef unsigned int (*StressDetectKernel)(const StressPositions& points, StressPositions& previous, double epsilon,
+                                           unsigned char* moved, unsigned int begin, unsigned int end);
+
+//hash of count 32 bit values, eight interleaved lanes so every level gives the same hash
+typedef uint64_t (*StressHashKernel)(const unsigned int* values, unsigned int count);
+
+//best level the running cpu supports, checked once
+StressSimdLevel stressBestSimdLevel();
+const char* stressSimdLevelName(StressSimdLevel level);
+
+//kernels for a given level, fall back to the next lower level the build has
+StressEdgeRatioKernel stressEdgeRatioKernel(StressSimdLevel level);
+StressEdgeRatioFloatKernel stressEdgeRatioFloatKernel(StressSimdLevel level);
+StressDetectKernel stressDetectKernel(StressSimdLevel level);
+StressHashKernel stressHashKernel(StressSimdLevel level);
+
+//copy interleaved xyz floats (MFnMesh::getRawPoints layout) into points[begin, end)
+void stressLoadPositions(const float* xyz, StressPositions& points, unsigned int begin, unsigned int end);
+void stressLoadPositions(const float* xyz, StressFloatPositions& points, unsigned int begin, unsigned int end);
+//same for only the listed points, the others are left alone
+void stressGatherPositions(const float* xyz, StressPositions& points, const unsigned int* indices, unsigned int count);
+
+#endif
@@ -0,0 +1,851 @@
+//stressTests.cpp
+//checks of the stress core against plain serial references, runs without maya
+//
+//usage: stressTests [--grid size] [check ...]
+//runs every check when none is named, returns nonzero when one fails
+
+#include "stressCache.h"
+#include "stressCore.h"
+#include "stressObj.h"
+#include "stressParallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+//every allocation of the process goes through here, the allocations check counts them
+static std::atomic<unsigned long long> allocationCount(0);
+
+void* operator new(std::size_t size){
+  allocationCount++;
+  if(void* memory = std::malloc(size != 0 ? size : 1)) return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept{
+  std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept{
+  std::free(memory);
+}
+
+//the rest pose, a stretched and waved pose of it and the full evaluation of that pose
+struct StressFixture{
+  StressObjMesh reference;
+  StressPositions deformed;
+  StressTopology topology;
+  std::vector<double> invRestLengths;
+  StressTriangles triangles;
+  StressFingerprint fingerprint;
+  StressSettings settings;
+  std::vector<double> values;
+  StressStats stats;
+  std::vector<float> raw;
+
+  unsigned int numVertices() const { return topology.numVertices(); };
+};
+
+//size x size quad grid, the deformed pose is stretched and waved
+static void buildGrid(unsigned int size, StressObjMesh& reference, StressPositions& deformed){
+  const unsigned int numVertices = size * size;
+  reference.points.resize(numVertices);
+  deformed.resize(numVertices);
+
+  for(unsigned int j=0; j<size; j++){
+    for(unsigned int i=0; i<size; i++){
+      const unsigned int v = j * size + i;
+      const double u = static_cast<double>(i) / size;
+      reference.points.x[v] = i;
+      reference.points.y[v] = 0.0;
+      reference.points.z[v] = j;
+      deformed.x[v] = i * (1.0 + 0.3 * u);
+      deformed.y[v] = std::sin(u * 12.0) * 2.0;
+      deformed.z[v] = j * (1.0 - 0.2 * u);
+    }
+  }
+
+  reference.faceCounts.assign((size - 1) * (size - 1), 4);
+  reference.faceConnects.clear();
+  reference.faceConnects.reserve(reference.faceCounts.size() * 4);
+  for(unsigned int j=0; j+1<size; j++){
+    for(unsigned int i=0; i+1<size; i++){
+      const unsigned int v = j * size + i;
+      reference.faceConnects.push_back(v);
+      reference.faceConnects.push_back(v + 1);
+      reference.faceConnects.push_back(v + size + 1);
+      reference.faceConnects.push_back(v + size);
+    }
+  }
+}
+
+static void buildFixture(unsigned int size, StressFixture& fixture){
+  buildGrid(size, fixture.reference, fixture.deformed);
+  const StressObjMesh& reference = fixture.reference;
+
+  std::vector<unsigned int> edgeVertices;
+  stressEdgesFromFaces(reference.points.size(), reference.faceCounts, reference.faceConnects, edgeVertices);
+  stressBuildTopology(fixture.topology, reference.points.size(), edgeVertices.data(), static_cast<unsigned int>(edgeVertices.size() / 2));
+  stressBuildRestLengths(fixture.topology, reference.points, fixture.invRestLengths);
+
+  std::vector<unsigned int> triangleVertices;
+  stressTriangulateFaces(reference.faceCounts, reference.faceConnects, reference.points, triangleVertices);
+  stressBuildTriangles(fixture.triangles, reference.points.size(), triangleVertices.data(),
+                       static_cast<unsigned int>(triangleVertices.size() / 3), reference.points);
+  fixture.fingerprint = stressFingerprint(reference.points.size(), reference.faceCounts.data(),
+                                          static_cast<unsigned int>(reference.faceCounts.size()),
+                                          reference.faceConnects.data(), static_cast<unsigned int>(reference.faceConnects.size()));
+
+  const unsigned int numVertices = fixture.numVertices();
+  fixture.values.resize(numVertices);
+  StressKernel kernel;
+  kernel.compute(fixture.topology, fixture.invRestLengths, fixture.deformed, fixture.settings, fixture.values.data(), &fixture.stats);
+
+  //the interleaved floats maya hands over
+  fixture.raw.resize(static_cast<size_t>(numVertices) * 3);
+  for(unsigned int v=0; v<numVertices; v++){
+    fixture.raw[3 * v] = static_cast<float>(fixture.deformed.x[v]);
+    fixture.raw[3 * v + 1] = static_cast<float>(fixture.deformed.y[v]);
+    fixture.raw[3 * v + 2] = static_cast<float>(fixture.deformed.z[v]);
+  }
+}
+
+static bool fail(const char* message){
+  std::fprintf(stderr, "stressTests: %s\n", message);
+  return false;
+}
+
+//every level the cpu supports, forced through setSimdLevel, has to agree with the scalar kernels,
+//the direct kernel calls start and stop off the vector width so the heads and tails are covered too
+static bool checkSimd(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const StressTopology& topology = fixture.topology;
+  const std::vector<unsigned int>& faceConnects = fixture.reference.faceConnects;
+  const unsigned int numEdges = topology.numEdges();
+  const unsigned int hashCount = faceConnects.size() > 3 ? static_cast<unsigned int>(faceConnects.size()) - 3 : 0;
+  const unsigned int begin = numEdges > 2 ? 1 : 0;
+  const unsigned int end = numEdges > 2 ? numEdges - 1 : numEdges;
+
+  const std::vector<float> invRestFloat(fixture.invRestLengths.begin(), fixture.invRestLengths.end());
+  StressFloatPositions rawFloat;
+  rawFloat.resize(numVertices);
+  stressLoadPositions(fixture.raw.data(), rawFloat, 0, numVertices);
+  StressPositions patched = fixture.deformed;
+  for(unsigned int v=0; v<numVertices; v+=7){
+    patched.y[v] += 0.25;
+  }
+
+  StressKernel scalarKernel;
+  scalarKernel.setSimdLevel(kStressScalar);
+  StressSettings serial = fixture.settings;
+  serial.numThreads = 1;
+  std::vector<double> expected(numVertices);
+  std::vector<double> expectedFloat(numVertices);
+  std::vector<double> expectedIncremental(numVertices);
+  scalarKernel.compute(topology, fixture.invRestLengths, fixture.deformed, serial, expected.data());
+  scalarKernel.computeFloat(topology, invRestFloat, rawFloat, serial, expectedFloat.data());
+  scalarKernel.computeIncremental(topology, fixture.invRestLengths, fixture.deformed, serial, 0.0, expectedIncremental.data());
+  const unsigned int expectedRecomputed = scalarKernel.computeIncremental(topology, fixture.invRestLengths, patched, serial, 0.0,
+                                                                          expectedIncremental.data());
+  std::vector<double> expectedRatios(numEdges, -1.0);
+  std::vector<float> expectedFloatRatios(numEdges, -1.0f);
+  stressEdgeRatioKernel(kStressScalar)(fixture.deformed, topology.edgeFrom.data(), topology.edgeTo.data(), fixture.invRestLengths.data(),
+                                       expectedRatios.data(), begin, end);
+  stressEdgeRatioFloatKernel(kStressScalar)(rawFloat, topology.edgeFrom.data(), topology.edgeTo.data(), invRestFloat.data(),
+                                            expectedFloatRatios.data(), begin, end);
+  const uint64_t expectedHash = stressHashKernel(kStressScalar)(faceConnects.data(), hashCount);
+
+  bool matches = true;
+  for(int l=kStressScalar; l<=stressBestSimdLevel(); l++){
+    const StressSimdLevel level = static_cast<StressSimdLevel>(l);
+    StressKernel kernel;
+    kernel.setSimdLevel(level);
+    std::vector<double> values(numVertices);
+    std::vector<double> floatValues(numVertices);
+    std::vector<double> incremental(numVertices);
+    kernel.compute(topology, fixture.invRestLengths, fixture.deformed, fixture.settings, values.data());
+    kernel.computeFloat(topology, invRestFloat, rawFloat, fixture.settings, floatValues.data());
+    kernel.computeIncremental(topology, fixture.invRestLengths, fixture.deformed, fixture.settings, 0.0, incremental.data());
+    const unsigned int recomputed = kernel.computeIncremental(topology, fixture.invRestLengths, patched, fixture.settings, 0.0,
+                                                              incremental.data());
+
+    std::vector<double> ratios(numEdges, -1.0);
+    std::vector<float> floatRatios(numEdges, -1.0f);
+    stressEdgeRatioKernel(level)(fixture.deformed, topology.edgeFrom.data(), topology.edgeTo.data(), fixture.invRestLengths.data(),
+                                 ratios.data(), begin, end);
+    stressEdgeRatioFloatKernel(level)(rawFloat, topology.edgeFrom.data(), topology.edgeTo.data(), invRestFloat.data(),
+                                      floatRatios.data(), begin, end);
+    const uint64_t hash = stressHashKernel(level)(faceConnects.data(), hashCount);
+
+    double maxDiff = 0.0;
+    for(unsigned int v=0; v<numVertices; v++){
+      maxDiff = std::max(maxDiff, std::fabs(values[v] - expected[v]));
+    }
+    for(unsigned int e=0; e<numEdges; e++){
+      maxDiff = std::max(maxDiff, std::fabs(ratios[e] - expectedRatios[e]));
+    }
+    const bool floatIdentical = floatRatios == expectedFloatRatios &&
+                                std::memcmp(floatValues.data(), expectedFloat.data(), numVertices * sizeof(double)) == 0;
+    const bool detectIdentical = recomputed == expectedRecomputed &&
+                                 std::memcmp(incremental.data(), expectedIncremental.data(), numVertices * sizeof(double)) == 0;
+    std::printf("check simd     %-6s max diff %g, %u of %u vertices recomputed\n", stressSimdLevelName(kernel.simdLevel()), maxDiff,
+                recomputed, numVertices);
+    if(maxDiff > 1e-12){
+      matches = fail("a double precision kernel differs from the scalar reference");
+    }
+    if(!floatIdentical){
+      matches = fail("a single precision kernel differs from the scalar reference");
+    }
+    if(!detectIdentical){
+      matches = fail("the moved point detection differs from the scalar reference");
+    }
+    if(hash != expectedHash){
+      matches = fail("the topology hash differs from the scalar reference");
+    }
+  }
+  return matches;
+}
+
+//the same stats to the bit, field by field since the struct has padding
+static bool sameStats(const StressStats& a, const StressStats& b){
+  return std::memcmp(&a.minimum, &b.minimum, sizeof(double)) == 0 && std::memcmp(&a.maximum, &b.maximum, sizeof(double)) == 0 &&
+         std::memcmp(&a.mean, &b.mean, sizeof(double)) == 0 && a.count == b.count &&
+         std::memcmp(a.histogram, b.histogram, sizeof(a.histogram)) == 0;
+}
+
+//every parallel kernel on one thread and on several, with a small grain so there are many chunks,
+//has to give the same bits, values and stats alike
+static bool checkThreads(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const StressTopology& topology = fixture.topology;
+  const std::vector<float> invRestFloat(fixture.invRestLengths.begin(), fixture.invRestLengths.end());
+  StressFloatPositions rawFloat;
+  rawFloat.resize(numVertices);
+  stressLoadPositions(fixture.raw.data(), rawFloat, 0, numVertices);
+  StressPositions patched = fixture.deformed;
+  for(unsigned int v=0; v<numVertices; v+=7){
+    patched.y[v] += 0.25;
+  }
+  std::vector<unsigned char> active(numVertices, 0);
+  std::fill(active.begin(), active.begin() + numVertices / 3, 1);
+  StressMask mask;
+  stressBuildMask(mask, topology, active.data());
+
+  const unsigned int numThreads[2] = {1, std::max(4u, stressHardwareThreads())};
+  std::vector<double> results[2];
+  std::vector<StressStats> stats[2];
+  for(int t=0; t<2; t++){
+    StressSettings settings = fixture.settings;
+    settings.numThreads = numThreads[t];
+    settings.grainSize = 64;
+    std::vector<double>& values = results[t];
+    values.assign(static_cast<size_t>(numVertices) * 7, 0.0);
+    stats[t].resize(5);
+    double* out = values.data();
+    StressKernel kernel;
+    kernel.compute(topology, fixture.invRestLengths, fixture.deformed, settings, out, &stats[t][0]);
+    kernel.computeFloat(topology, invRestFloat, rawFloat, settings, out + numVertices, &stats[t][1]);
+    kernel.computeIncremental(topology, fixture.invRestLengths, fixture.deformed, settings, 0.0, out + 2 * numVertices);
+    kernel.computeIncremental(topology, fixture.invRestLengths, patched, settings, 0.0, out + 2 * numVertices, &stats[t][2]);
+    kernel.computeMasked(topology, fixture.invRestLengths, fixture.deformed, settings, mask, out + 3 * numVertices, &stats[t][3]);
+    kernel.computeTriangleMetrics(fixture.triangles, fixture.deformed, settings, out + 4 * numVertices, out + 5 * numVertices,
+                                  out + 6 * numVertices, kStressMajorStrain, &stats[t][4]);
+  }
+  bool matches = std::memcmp(results[0].data(), results[1].data(), results[0].size() * sizeof(double)) == 0;
+  for(size_t i=0; i<stats[0].size(); i++){
+    matches = matches && sameStats(stats[0][i], stats[1][i]);
+  }
+  std::printf("check threads  1 and %u threads, %s\n", numThreads[1], matches ? "bitwise identical" : "different");
+  if(!matches) return fail("a kernel gives other bits on more threads");
+  return true;
+}
+
+//fused stats against a plain second pass over the values
+static bool checkStats(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const StressStats& stats = fixture.stats;
+  StressStats expected;
+  double sum = 0.0;
+  for(unsigned int v=0; v<numVertices; v++){
+    const double value = fixture.values[v];
+    expected.minimum = v == 0 || value < expected.minimum ? value : expected.minimum;
+    expected.maximum = v == 0 || value > expected.maximum ? value : expected.maximum;
+    sum += value;
+    const double position = (value + fixture.settings.histogramRange) * kStressHistogramBuckets / (2.0 * fixture.settings.histogramRange);
+    const unsigned int bucket = position <= 0.0 ? 0 : std::min(kStressHistogramBuckets - 1, static_cast<unsigned int>(position));
+    expected.histogram[bucket]++;
+  }
+  expected.mean = numVertices != 0 ? sum / numVertices : 0.0;
+  std::printf("check stats    min %g, max %g, mean %g\n", stats.minimum, stats.maximum, stats.mean);
+  if(stats.minimum != expected.minimum || stats.maximum != expected.maximum ||
+     std::fabs(stats.mean - expected.mean) > 1e-12 * (1.0 + std::fabs(expected.mean)) ||
+     std::memcmp(stats.histogram, expected.histogram, sizeof(stats.histogram)) != 0){
+    return fail("fused stats differ from a separate pass");
+  }
+  return true;
+}
+
+//incremental pass after moving a small patch, epsilon 0 so the result has to match a full pass
+static bool checkIncremental(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  StressPositions patched = fixture.deformed;
+  const unsigned int patchSize = numVertices / 100 > 0 ? numVertices / 100 : 1;
+  for(unsigned int v=0; v<patchSize && v<numVertices; v++){
+    patched.y[v] += 0.25;
+  }
+  std::vector<double> incremental(numVertices);
+  StressKernel incrementalKernel;
+  StressStats incrementalStats;
+  incrementalKernel.computeIncremental(fixture.topology, fixture.invRestLengths, fixture.deformed, fixture.settings, 0.0, incremental.data());
+  const unsigned int recomputed = incrementalKernel.computeIncremental(fixture.topology, fixture.invRestLengths, patched, fixture.settings, 0.0,
+                                                                       incremental.data(), &incrementalStats);
+
+  StressKernel kernel;
+  std::vector<double> expected(numVertices);
+  StressStats expectedStats;
+  kernel.compute(fixture.topology, fixture.invRestLengths, patched, fixture.settings, expected.data(), &expectedStats);
+
+  std::printf("check incremental %u of %u vertices recomputed\n", recomputed, numVertices);
+  if(std::memcmp(incremental.data(), expected.data(), numVertices * sizeof(double)) != 0){
+    return fail("incremental evaluation differs from a full evaluation");
+  }
+  if(incrementalStats.minimum != expectedStats.minimum || incrementalStats.maximum != expectedStats.maximum ||
+     incrementalStats.mean != expectedStats.mean ||
+     std::memcmp(incrementalStats.histogram, expectedStats.histogram, sizeof(expectedStats.histogram)) != 0){
+    return fail("incremental stats differ from a full evaluation");
+  }
+  return true;
+}
+
+//the masked pass matches the full one inside the mask and never writes outside it
+static bool checkMask(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  std::vector<unsigned char> active(numVertices, 0);
+  std::fill(active.begin(), active.begin() + numVertices / 10, 1);
+  StressMask mask;
+  stressBuildMask(mask, fixture.topology, active.data());
+  std::vector<double> masked(numVertices, std::numeric_limits<double>::quiet_NaN());
+  StressStats maskedStats;
+  StressKernel kernel;
+  kernel.computeMasked(fixture.topology, fixture.invRestLengths, fixture.deformed, fixture.settings, mask, masked.data(), &maskedStats);
+
+  bool matches = true;
+  double sum = 0.0;
+  for(unsigned int v=0; v<numVertices; v++){
+    if(active[v]){
+      matches = matches && masked[v] == fixture.values[v];
+      sum += fixture.values[v];
+    }
+    else{
+      matches = matches && std::isnan(masked[v]);
+    }
+  }
+  std::printf("check mask     %zu of %u vertices, %zu of %u edges\n", mask.vertices.size(), numVertices, mask.edges.size(), fixture.topology.numEdges());
+  if(!matches || maskedStats.count != mask.vertices.size() ||
+     (!mask.empty() && std::fabs(maskedStats.mean - sum / mask.vertices.size()) > 1e-12 * (1.0 + std::fabs(maskedStats.mean)))){
+    return fail("the masked evaluation differs from the full one or wrote outside the mask");
+  }
+  return true;
+}
+
+//single precision stays close to double on the same floats, the uint8 copy within half a step
+static bool checkFloat(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const std::vector<float> invRestFloat(fixture.invRestLengths.begin(), fixture.invRestLengths.end());
+  StressPositions rawDouble;
+  StressFloatPositions rawFloat;
+  rawDouble.resize(numVertices);
+  rawFloat.resize(numVertices);
+  stressLoadPositions(fixture.raw.data(), rawDouble, 0, numVertices);
+  stressLoadPositions(fixture.raw.data(), rawFloat, 0, numVertices);
+
+  StressKernel kernel;
+  std::vector<double> doubleValues(numVertices);
+  std::vector<double> floatValues(numVertices);
+  kernel.compute(fixture.topology, fixture.invRestLengths, rawDouble, fixture.settings, doubleValues.data());
+  kernel.computeFloat(fixture.topology, invRestFloat, rawFloat, fixture.settings, floatValues.data());
+
+  std::vector<unsigned char> compact(numVertices);
+  float compactOffset = 0.0f;
+  float compactScale = 0.0f;
+  stressUint8Range(fixture.stats.minimum, fixture.stats.maximum, compactOffset, compactScale);
+  stressEncodeUint8(fixture.values.data(), numVertices, compactOffset, compactScale, compact.data());
+
+  double floatError = 0.0;
+  double compactError = 0.0;
+  for(unsigned int v=0; v<numVertices; v++){
+    floatError = std::max(floatError, std::fabs(floatValues[v] - doubleValues[v]));
+    compactError = std::max(compactError, std::fabs(compactOffset + compact[v] * static_cast<double>(compactScale) - fixture.values[v]));
+  }
+  const double floatTolerance = 1e-5 * (1.0 + std::fabs(fixture.settings.multiplier));
+  std::printf("check float    max error %g, uint8 max error %g, step %g\n", floatError, compactError, compactScale);
+  if(floatError > floatTolerance) return fail("single precision is too far from double");
+  if(compactError > 0.5 * compactScale + 1e-6 * (1.0 + std::fabs(fixture.stats.maximum - fixture.stats.minimum))){
+    return fail("the uint8 copy is off by more than half a step");
+  }
+  return true;
+}
+
+//every vertex and edge sits in exactly one cluster and inside its bounds, an orthographic view around the mesh
+//keeps every cluster, the same view one pixel wide makes them all coarse and moved aside culls them
+static bool checkClusters(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const StressTopology& topology = fixture.topology;
+  const std::vector<float>& raw = fixture.raw;
+  std::vector<float> restRaw(static_cast<size_t>(numVertices) * 3);
+  for(unsigned int v=0; v<numVertices; v++){
+    restRaw[3 * v] = static_cast<float>(fixture.reference.points.x[v]);
+    restRaw[3 * v + 1] = static_cast<float>(fixture.reference.points.y[v]);
+    restRaw[3 * v + 2] = static_cast<float>(fixture.reference.points.z[v]);
+  }
+  StressClusters clusters;
+  stressBuildClusters(clusters, topology, restRaw.data(), 256);
+  std::vector<float> clusterBounds;
+  stressClusterBounds(clusters, raw.data(), fixture.settings, clusterBounds);
+
+  std::vector<unsigned int> vertexSeen(numVertices, 0);
+  bool matches = clusters.vertices.size() == numVertices && clusters.edges.size() == topology.numEdges() &&
+                 clusterBounds.size() == 6 * static_cast<size_t>(clusters.numClusters());
+  float low[3] = {raw[0], raw[1], raw[2]};
+  float high[3] = {raw[0], raw[1], raw[2]};
+  for(unsigned int c=0; matches && c<clusters.numClusters(); c++){
+    const float* box = &clusterBounds[6 * c];
+    for(unsigned int i=clusters.offsets[c]; i<clusters.offsets[c+1]; i++){
+      const unsigned int v = clusters.vertices[i];
+      vertexSeen[v]++;
+      for(unsigned int a=0; a<3; a++){
+        matches = matches && raw[3 * v + a] >= box[a] && raw[3 * v + a] <= box[a + 3];
+        low[a] = std::min(low[a], raw[3 * v + a]);
+        high[a] = std::max(high[a], raw[3 * v + a]);
+      }
+    }
+  }
+  matches = matches && std::count(vertexSeen.begin(), vertexSeen.end(), 1u) == static_cast<std::ptrdiff_t>(numVertices);
+  double extent = 1e-12;
+  for(unsigned int a=0; a<3; a++){
+    extent = std::max(extent, 0.5 * (high[a] - low[a]));
+  }
+  double view[16] = {};
+  for(unsigned int a=0; a<3; a++){
+    view[5 * a] = 1.0 / extent;
+    view[12 + a] = -0.5 * (low[a] + high[a]) / extent;
+  }
+  view[15] = 1.0;
+  std::vector<unsigned char> states(clusters.numClusters());
+  std::vector<unsigned int> clusterLines;
+  std::vector<unsigned int> clusterPoints;
+  stressClassifyClusters(clusterBounds, view, 1000.0, 1000.0, true, 0.0, states.data());
+  stressClusterLines(clusters, topology, states.data(), clusterLines);
+  matches = matches && std::count(states.begin(), states.end(), kStressClusterFull) == static_cast<std::ptrdiff_t>(states.size()) &&
+            clusterLines.size() == 2 * static_cast<size_t>(topology.numEdges());
+  stressClassifyClusters(clusterBounds, view, 1.0, 1.0, true, 4.0, states.data());
+  stressClusterPoints(clusters, states.data(), clusterPoints);
+  matches = matches && clusterPoints.size() == clusters.numClusters();
+  view[12] += 10.0;
+  stressClassifyClusters(clusterBounds, view, 1000.0, 1000.0, true, 4.0, states.data());
+  stressClusterLines(clusters, topology, states.data(), clusterLines);
+  matches = matches && clusterLines.empty();
+  std::printf("check clusters %u clusters, %zu coarse lines\n", clusters.numClusters(), clusters.coarseFrom.size());
+  if(!matches) return fail("clusters miss a vertex or edge, or their bounds and view states are wrong");
+  return true;
+}
+
+//the smoothing passes match a serial one pass at a time over a copy, a constant field stays put
+//and the thread count doesn't change a bit
+static bool checkSmooth(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const StressTopology& topology = fixture.topology;
+  StressSettings smoothSettings = fixture.settings;
+  smoothSettings.smoothIterations = 10;
+  std::vector<double> smoothed = fixture.values;
+  StressKernel kernel;
+  kernel.smooth(topology, smoothSettings, smoothed.data());
+
+  std::vector<double> expected = fixture.values;
+  std::vector<double> scratch(numVertices);
+  for(unsigned int i=0; i<smoothSettings.smoothIterations; i++){
+    for(unsigned int v=0; v<numVertices; v++){
+      const unsigned int first = topology.offsets[v];
+      const unsigned int last = topology.offsets[v + 1];
+      double sum = 0.0;
+      for(unsigned int n=first; n<last; n++){
+        sum += expected[topology.neighbors[n]];
+      }
+      scratch[v] = last != first ? expected[v] + smoothSettings.smoothStrength * (sum / (last - first) - expected[v]) : expected[v];
+    }
+    expected.swap(scratch);
+  }
+  std::vector<double> constantField(numVertices, 0.375);
+  StressSettings smoothOdd = smoothSettings;
+  smoothOdd.smoothIterations = 3;
+  kernel.smooth(topology, smoothOdd, constantField.data());
+
+  //one thread and several, with many chunks, give the same bits and stats
+  StressSettings smoothThreads[2] = {smoothSettings, smoothSettings};
+  std::vector<double> threadValues[2] = {fixture.values, fixture.values};
+  StressStats threadStats[2];
+  for(int t=0; t<2; t++){
+    smoothThreads[t].numThreads = t == 0 ? 1 : std::max(4u, stressHardwareThreads());
+    smoothThreads[t].grainSize = 64;
+    StressKernel threadKernel;
+    threadKernel.smooth(topology, smoothThreads[t], threadValues[t].data(), &threadStats[t]);
+  }
+  const bool threadsIdentical = std::memcmp(threadValues[0].data(), threadValues[1].data(), numVertices * sizeof(double)) == 0 &&
+                                sameStats(threadStats[0], threadStats[1]);
+
+  std::printf("check smooth   %u passes, strength %g, 1 and %u threads %s\n", smoothSettings.smoothIterations, smoothSettings.smoothStrength,
+              smoothThreads[1].numThreads, threadsIdentical ? "bitwise identical" : "different");
+  if(smoothed != expected || std::count(constantField.begin(), constantField.end(), 0.375) != static_cast<std::ptrdiff_t>(numVertices)){
+    return fail("smoothing differs from serial passes or moved a constant field");
+  }
+  if(!threadsIdentical) return fail("smoothing gives other bits on more threads");
+  return true;
+}
+
+//every temporal mode against a serial fold of the same frames, a frame that isn't folded changes nothing
+static bool checkTemporal(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const std::vector<double>& values = fixture.values;
+  const unsigned int numFrames = 30;
+  const unsigned int window = 24;
+  const double smoothing = 0.25;
+  auto frameWeight = [](unsigned int f){ return static_cast<double>(static_cast<int>((f * 7) % 11) - 5) / 5.0; };
+
+  StressTemporal windowTemporal;
+  StressTemporal averageTemporal;
+  StressTemporal peakTemporal;
+  std::vector<double> frameValues(numVertices);
+  std::vector<double> windowValues(numVertices);
+  std::vector<double> averageValues(numVertices);
+  std::vector<double> peakValues(numVertices);
+  std::vector<double> expectedAverage(numVertices);
+  std::vector<double> expectedPeak(numVertices);
+  bool windowMatches = true;
+  for(unsigned int f=0; f<numFrames; f++){
+    for(unsigned int v=0; v<numVertices; v++){
+      frameValues[v] = values[v] * frameWeight(f);
+      expectedAverage[v] = f == 0 ? frameValues[v] : expectedAverage[v] + smoothing * (frameValues[v] - expectedAverage[v]);
+      expectedPeak[v] = f == 0 || std::fabs(frameValues[v]) > std::fabs(expectedPeak[v]) ? frameValues[v] : expectedPeak[v];
+    }
+    windowValues = frameValues;
+    averageValues = frameValues;
+    peakValues = frameValues;
+    windowTemporal.accumulate(kStressTemporalWindow, window, 0.0, true, windowValues.data(), numVertices, fixture.settings);
+    averageTemporal.accumulate(kStressTemporalAverage, 1, smoothing, true, averageValues.data(), numVertices, fixture.settings);
+    peakTemporal.accumulate(kStressTemporalPeak, 1, smoothing, true, peakValues.data(), numVertices, fixture.settings);
+
+    //the window after every frame, newest to oldest so a tie keeps the newest frame,
+    //the weights repeat and come in both signs so there are ties of both kinds
+    const unsigned int oldest = f + 1 > window ? f + 1 - window : 0;
+    for(unsigned int v=0; v<numVertices; v++){
+      double expectedWindow = frameValues[v];
+      for(unsigned int g=f; g>oldest; g--){
+        const double frame = values[v] * frameWeight(g - 1);
+        if(std::fabs(frame) > std::fabs(expectedWindow)) expectedWindow = frame;
+      }
+      windowMatches = windowMatches && windowValues[v] == expectedWindow;
+    }
+  }
+  double averageError = 0.0;
+  bool matches = windowMatches && peakValues == expectedPeak;
+  for(unsigned int v=0; v<numVertices; v++){
+    averageError = std::max(averageError, std::fabs(averageValues[v] - expectedAverage[v]));
+  }
+  //the same frame evaluated again, with other values, keeps what every mode held
+  std::fill(frameValues.begin(), frameValues.end(), 1e9);
+  windowTemporal.accumulate(kStressTemporalWindow, window, 0.0, false, frameValues.data(), numVertices, fixture.settings);
+  matches = matches && frameValues == windowValues;
+  std::fill(frameValues.begin(), frameValues.end(), 1e9);
+  averageTemporal.accumulate(kStressTemporalAverage, 1, smoothing, false, frameValues.data(), numVertices, fixture.settings);
+  matches = matches && frameValues == averageValues;
+  std::fill(frameValues.begin(), frameValues.end(), 1e9);
+  peakTemporal.accumulate(kStressTemporalPeak, 1, smoothing, false, frameValues.data(), numVertices, fixture.settings);
+  matches = matches && frameValues == peakValues;
+  std::printf("check temporal %u frames, average error %g\n", numFrames, averageError);
+  if(!matches || averageError > 1e-12 * (1.0 + fixture.stats.maximum)){
+    return fail("temporal accumulation differs from a serial fold of the frames");
+  }
+  return true;
+}
+
+//the reference stretched twice along x doubles the area and the major stretch, the minor one stays,
+//a shear along x keeps the area but not the stretches
+static bool checkStrains(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  StressSettings plain;
+  StressPositions stretched = fixture.reference.points;
+  StressPositions sheared = fixture.reference.points;
+  for(unsigned int v=0; v<numVertices; v++){
+    stretched.x[v] *= 2.0;
+    sheared.x[v] += 0.5 * sheared.z[v];
+  }
+  std::vector<double> areaValues(numVertices);
+  std::vector<double> majorValues(numVertices);
+  std::vector<double> minorValues(numVertices);
+  StressKernel kernel;
+  double stretchError = 0.0;
+  kernel.computeTriangleMetrics(fixture.triangles, stretched, plain, areaValues.data(), majorValues.data(), minorValues.data());
+  for(unsigned int v=0; v<numVertices; v++){
+    stretchError = std::max(stretchError, std::fabs(areaValues[v] - 1.0));
+    stretchError = std::max(stretchError, std::fabs(majorValues[v] - 1.0));
+    stretchError = std::max(stretchError, std::fabs(minorValues[v]));
+  }
+  double shearError = 0.0;
+  double shearMajor = 0.0;
+  kernel.computeTriangleMetrics(fixture.triangles, sheared, plain, areaValues.data(), majorValues.data(), minorValues.data());
+  for(unsigned int v=0; v<numVertices; v++){
+    shearError = std::max(shearError, std::fabs(areaValues[v]));
+    shearMajor = std::max(shearMajor, majorValues[v]);
+  }
+  std::printf("check strains  stretch error %g, shear area error %g, shear major %g\n", stretchError, shearError, shearMajor);
+  if(!fixture.triangles.vertices.empty() && (stretchError > 1e-9 || shearError > 1e-9 || shearMajor <= 0.0)){
+    return fail("triangle metrics are off on a uniform stretch or shear");
+  }
+  return true;
+}
+
+//two faces trading a vertex is a new topology with the same counts,
+//the saved copy rebuilds the same tree and rest lengths and a truncated one is refused
+static bool checkTopology(const StressFixture& fixture){
+  const StressObjMesh& reference = fixture.reference;
+  const unsigned int numFaces = static_cast<unsigned int>(reference.faceCounts.size());
+  const unsigned int numFaceVertices = static_cast<unsigned int>(reference.faceConnects.size());
+  bool detectsChange = true;
+  if(numFaceVertices >= 2 && reference.faceConnects.front() != reference.faceConnects.back()){
+    std::vector<unsigned int> swapped = reference.faceConnects;
+    std::swap(swapped.front(), swapped.back());
+    detectsChange = stressFingerprint(reference.points.size(), reference.faceCounts.data(), numFaces, swapped.data(), numFaceVertices) != fixture.fingerprint;
+  }
+
+  std::vector<unsigned char> saved;
+  stressWriteTopology(fixture.fingerprint, 1, fixture.topology, fixture.invRestLengths, saved);
+  StressFingerprint loadedFingerprint;
+  uint64_t loadedPointsHash = 0;
+  StressTopology loaded;
+  std::vector<double> loadedRestLengths;
+  const bool loadedOk = stressReadTopology(saved.data(), saved.size(), loadedFingerprint, loadedPointsHash, loaded, loadedRestLengths);
+  const bool roundTrip = loadedOk && loadedFingerprint == fixture.fingerprint && loadedPointsHash == 1 &&
+                         loaded.offsets == fixture.topology.offsets && loaded.neighbors == fixture.topology.neighbors &&
+                         loaded.neighborEdges == fixture.topology.neighborEdges && loadedRestLengths == fixture.invRestLengths;
+  const bool truncatedRefused = !stressReadTopology(saved.data(), saved.size() - 1, loadedFingerprint, loadedPointsHash, loaded, loadedRestLengths);
+  std::printf("check topology hash %016llx, saved copy %zu bytes\n", static_cast<unsigned long long>(fixture.fingerprint.hash), saved.size());
+  if(!roundTrip || !truncatedRefused) return fail("the saved topology doesn't read back the same tree");
+  if(!detectsChange) return fail("the topology fingerprint misses a changed face");
+  return true;
+}
+
+//bake two frames in both encodings and decode them again, the error has to stay within one quantization step
+//and the cluster bounds stored with every frame come back as they were written
+static bool checkCache(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  std::vector<double> scaled(numVertices);
+  for(unsigned int v=0; v<numVertices; v++){
+    scaled[v] = fixture.values[v] * -0.5;
+  }
+  const std::vector<double>* frames[2] = {&fixture.values, &scaled};
+  StressClusters clusters;
+  stressBuildClusters(clusters, fixture.topology, fixture.raw.data(), 256);
+  std::vector<float> clusterBounds[2];
+  stressClusterBounds(clusters, fixture.raw.data(), fixture.settings, clusterBounds[0]);
+  clusterBounds[1] = clusterBounds[0];
+  for(float& bound : clusterBounds[1]) bound *= 2.0f;
+  const unsigned int clusterCount = clusters.numClusters();
+  bool boundsMatch = true;
+  const std::string path = "stressTests.cache";
+  const StressCacheEncoding encodings[] = {kStressCacheUint8, kStressCacheHalf};
+  bool withinStep = true;
+  for(const StressCacheEncoding encoding : encodings){
+    std::string error;
+    StressCacheWriter writer;
+    StressCacheReader reader;
+    const bool written = writer.open(path, numVertices, 1, encoding, 256, clusterCount, error) &&
+                         writer.writeFrame(frames[0]->data(), clusterBounds[0].data(), error) &&
+                         writer.writeFrame(frames[1]->data(), clusterBounds[1].data(), error) && writer.close(error);
+    if(!written || !reader.open(path, error)){
+      std::remove(path.c_str());
+      return fail(error.c_str());
+    }
+
+    std::vector<double> decoded(numVertices);
+    std::vector<float> decodedBounds(6 * static_cast<size_t>(reader.clusterCount()));
+    double maxError = 0.0;
+    for(int f=0; f<2; f++){
+      reader.readFrame(f + 1, decoded.data());
+      reader.readClusterBounds(f + 1, decodedBounds.data());
+      boundsMatch = boundsMatch && reader.clusterSize() == 256 && decodedBounds == clusterBounds[f];
+      const std::vector<double>& expected = *frames[f];
+      double low = 0.0;
+      double high = 0.0;
+      for(unsigned int v=0; v<numVertices; v++){
+        low = v == 0 || expected[v] < low ? expected[v] : low;
+        high = v == 0 || expected[v] > high ? expected[v] : high;
+      }
+      //half a step of 8 bits over the range, or half an ulp of a float16 in [-1, 1] over half the range
+      const double step = encoding == kStressCacheHalf ? (high - low) * 0.5 / 2048.0 : (high - low) * 0.5 / 255.0;
+      double frameError = 0.0;
+      for(unsigned int v=0; v<numVertices; v++){
+        frameError = std::max(frameError, std::fabs(decoded[v] - expected[v]));
+      }
+      maxError = std::max(maxError, frameError);
+      if(frameError > step * 1.001 + 1e-7) withinStep = false;
+    }
+    reader.close();
+    std::printf("check cache    %s, %zu bytes, max error %g\n", encoding == kStressCacheHalf ? "half" : "uint8",
+                sizeof(StressCacheHeader) + 2 * stressCacheFrameSize(numVertices, encoding, clusterCount), maxError);
+  }
+  std::remove(path.c_str());
+  if(!withinStep) return fail("decoded cache values are off by more than one quantization step");
+  if(!boundsMatch) return fail("the cache doesn't read back the cluster bounds it was written with");
+  return true;
+}
+
+//concave faces are split inside of themselves: a dart quad whose first vertex can't see the others, where the
+//fan would flip a triangle, and an L shaped hexagon, every triangle turns with its face and they add up to its area
+static bool checkTriangulation(const StressFixture&){
+  const double xy[][2] = {{2.0, -1.0}, {1.0, 0.0}, {2.0, 1.0}, {0.0, 0.0},
+                          {0.0, 0.0}, {2.0, 0.0}, {2.0, 1.0}, {1.0, 1.0}, {1.0, 2.0}, {0.0, 2.0}};
+  const double faceAreas[2] = {1.0, 3.0};
+  StressPositions points;
+  points.resize(10);
+  for(unsigned int v=0; v<10; v++){
+    points.x[v] = xy[v][0];
+    points.y[v] = 0.5 * xy[v][1];  //tilted out of the xy plane
+    points.z[v] = xy[v][1];
+  }
+  const std::vector<unsigned int> faceCounts = {4, 6};
+  const std::vector<unsigned int> faceConnects = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<unsigned int> triangleVertices;
+  stressTriangulateFaces(faceCounts, faceConnects, points, triangleVertices);
+
+  //the faces turn counterclockwise around the normal of their plane
+  const double n[3] = {0.0, -1.0, 0.5};
+  const double nLength = std::sqrt(n[1] * n[1] + n[2] * n[2]);
+  bool inside = triangleVertices.size() == 3 * (2 + 4);
+  double areas[2] = {0.0, 0.0};
+  for(size_t t=0; inside && t<triangleVertices.size()/3; t++){
+    const unsigned int a = triangleVertices[3 * t];
+    const unsigned int b = triangleVertices[3 * t + 1];
+    const unsigned int c = triangleVertices[3 * t + 2];
+    const double ab[3] = {points.x[b] - points.x[a], points.y[b] - points.y[a], points.z[b] - points.z[a]};
+    const double ac[3] = {points.x[c] - points.x[a], points.y[c] - points.y[a], points.z[c] - points.z[a]};
+    const double cross[3] = {ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]};
+    const double area = 0.5 * (cross[0] * n[0] + cross[1] * n[1] + cross[2] * n[2]) / nLength;
+    inside = area > 0.0;
+    areas[t < 2 ? 0 : 1] += area;
+  }
+  //the tilt stretches the plane by the normal's length
+  for(int f=0; f<2; f++){
+    inside = inside && std::fabs(areas[f] - faceAreas[f] * nLength) < 1e-12;
+  }
+  std::printf("check triangles %zu triangles of a dart and an L, %s\n", triangleVertices.size() / 3, inside ? "all inside" : "flipped");
+  if(!inside) return fail("a concave face got a triangle outside of it");
+  return true;
+}
+
+//once the kernels ran at a size, running them again allocates nothing, on one thread or on the pool's workers
+static bool checkAllocations(const StressFixture& fixture){
+  const unsigned int numVertices = fixture.numVertices();
+  const StressTopology& topology = fixture.topology;
+  StressPositions patched = fixture.deformed;
+  for(unsigned int v=0; v<numVertices; v+=7){
+    patched.y[v] += 0.25;
+  }
+
+  const unsigned int numThreads[2] = {1, std::max(4u, stressHardwareThreads())};
+  unsigned long long allocations[2];
+  for(int t=0; t<2; t++){
+    StressSettings settings = fixture.settings;
+    settings.numThreads = numThreads[t];
+    settings.grainSize = 64;
+    settings.smoothIterations = 3;
+    std::vector<double> values(numVertices);
+    StressStats stats;
+    StressKernel kernel;
+    const auto evaluate = [&](){
+      kernel.compute(topology, fixture.invRestLengths, fixture.deformed, settings, values.data(), &stats);
+      kernel.smooth(topology, settings, values.data(), &stats);
+      kernel.computeIncremental(topology, fixture.invRestLengths, patched, settings, 0.0, values.data(), &stats);
+      kernel.computeIncremental(topology, fixture.invRestLengths, fixture.deformed, settings, 0.0, values.data(), &stats);
+    };
+    evaluate();
+    const unsigned long long before = allocationCount;
+    for(int i=0; i<3; i++){
+      evaluate();
+    }
+    allocations[t] = allocationCount - before;
+  }
+  std::printf("check allocs   %llu on 1 thread, %llu on %u threads after the first evaluation\n",
+              allocations[0], allocations[1], numThreads[1]);
+  if(allocations[0] != 0 || allocations[1] != 0) return fail("a repeated evaluation allocated");
+  return true;
+}
+
+struct StressCheck{
+  const char* name;
+  bool (*run)(const StressFixture&);
+};
+
+static const StressCheck checks[] = {
+  {"simd", checkSimd},
+  {"threads", checkThreads},
+  {"stats", checkStats},
+  {"incremental", checkIncremental},
+  {"mask", checkMask},
+  {"float", checkFloat},
+  {"clusters", checkClusters},
+  {"smooth", checkSmooth},
+  {"temporal", checkTemporal},
+  {"strains", checkStrains},
+  {"triangulation", checkTriangulation},
+  {"topology", checkTopology},
+  {"cache", checkCache},
+  {"allocations", checkAllocations},
+};
+
+static void usage(){
+  std::fprintf(stderr, "usage: stressTests [--grid size] [check ...]\nchecks:");
+  for(const StressCheck& check : checks){
+    std::fprintf(stderr, " %s", check.name);
+  }
+  std::fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv){
+  unsigned int gridSize = 99;  //odd vertex and edge counts, so the vector kernels run their tails
+  std::vector<std::string> names;
+  for(int a=1; a<argc; a++){
+    if(!std::strcmp(argv[a], "--grid") && a + 1 < argc) gridSize = std::atoi(argv[++a]);
+    else if(argv[a][0] == '-'){
+      usage();
+      return 2;
+    }
+    else names.push_back(argv[a]);
+  }
+  if(gridSize < 2){
+    usage();
+    return 2;
+  }
+  for(const std::string& name : names){
+    if(std::none_of(std::begin(checks), std::end(checks), [&](const StressCheck& check){ return name == check.name; })){
+      usage();
+      return 2;
+    }
+  }
+
+  StressFixture fixture;
+  buildFixture(gridSize, fixture);
+
+  int result = 0;
+  for(const StressCheck& check : checks){
+    if(!names.empty() && std::find(names.begin(), names.end(), check.name) == names.end()) continue;
+    if(!check.run(fixture)) result = 1;
+  }
+  return result;
+}
@@ -0,0 +1,59 @@
+//stressTopologyData.cpp
+#include "stressTopologyData.h"
+
+#include <maya/MArgList.h>
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+const MTypeId StressTopologyData::id(0x9011E001);
+const MString StressTopologyData::typeName("stressTopologyData");
+
+//ascii files get the bytes as 32 bit words, the byte count first as the last word may be padded
+MStatus StressTopologyData::readASCII(const MArgList& args, unsigned int& lastElement){
+  MStatus status;
+  const int size = args.asInt(lastElement++, &status);
+  if(!status || size < 0) return MS::kFailure;
+
+  const unsigned int numWords = (static_cast<unsigned int>(size) + 3) / 4;
+  if(lastElement + numWords > args.length()) return MS::kFailure;
+  std::vector<unsigned char> read(static_cast<size_t>(numWords) * 4);
+  for(unsigned int w=0; w<numWords; w++){
+    const int word = args.asInt(lastElement++, &status);
+    if(!status) return MS::kFailure;
+    std::memcpy(&read[4 * w], &word, sizeof(word));
+  }
+  read.resize(static_cast<size_t>(size));
+  bytes.swap(read);
+  return MS::kSuccess;
+}
+
+MStatus StressTopologyData::writeASCII(std::ostream& out){
+  out << bytes.size();
+  const size_t numWords = (bytes.size() + 3) / 4;
+  for(size_t w=0; w<numWords; w++){
+    int word = 0;
+    std::memcpy(&word, &bytes[4 * w], std::min<size_t>(4, bytes.size() - 4 * w));
+    out << " " << word;
+  }
+  return out.fail() ? MS::kFailure : MS::kSuccess;
+}
+
+MStatus StressTopologyData::readBinary(std::istream& in, unsigned int length){
+  std::vector<unsigned char> read(length);
+  if(length != 0 && !in.read(reinterpret_cast<char*>(read.data()), length)) return MS::kFailure;
+  bytes.swap(read);
+  return MS::kSuccess;
+}
+
+MStatus StressTopologyData::writeBinary(std::ostream& out){
+  if(!bytes.empty()) out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  return out.fail() ? MS::kFailure : MS::kSuccess;
+}
+
+void StressTopologyData::copy(const MPxData& other){
+  const StressTopologyData* data = dynamic_cast<const StressTopologyData*>(&other);
+  if(data) bytes = data->bytes;
+}
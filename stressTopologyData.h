@@ -0,0 +1,31 @@
+//stressTopologyData.h
+//scene data holding a stressMap node's connection tree and rest lengths, see stressWriteTopology
+//saved with the scene so the first evaluation after a file open doesn't walk the reference's edges
+
+#ifndef stressTopologyData_H
+#define stressTopologyData_H
+
+#include <maya/MPxData.h>
+#include <maya/MString.h>
+#include <maya/MTypeId.h>
+#include <vector>
+
+class StressTopologyData final : public MPxData{
+  public:
+    static void* creator() { return new StressTopologyData(); };
+
+    MStatus readASCII(const MArgList& args, unsigned int& lastElement) override;
+    MStatus readBinary(std::istream& in, unsigned int length) override;
+    MStatus writeASCII(std::ostream& out) override;
+    MStatus writeBinary(std::ostream& out) override;
+    void copy(const MPxData& other) override;
+    MTypeId typeId() const override { return id; };
+    MString name() const override { return typeName; };
+
+    static const MTypeId id;
+    static const MString typeName;
+
+    std::vector<unsigned char> bytes;  //stressWriteTopology layout, empty until the node stored a tree
+};
+
+#endif